@@ -107,19 +107,25 @@ void reg_alloc(LLVMValueRef func) {
             // if instr is an instruction that does not have a result(e.g. store, branch, call that doesn't return a value)
             if (LLVMIsAStoreInst(i) || LLVMIsABranchInst(i) || (LLVMIsACallInst(i) && LLVMGetTypeKind(LLVMTypeOf(i)) == LLVMVoidTypeKind)) {
                 freeRegs(i, available_regs);
+                // there is no value to hold, taking a register would only
+                // keep it from a value when there are none left
+                continue;
             }
             // if the following about instr hold: a) is of type add/sub/mul...
             LLVMOpcode opc = LLVMGetInstructionOpcode(i);
-            if (opc == LLVMAdd || opc == LLVMSub || opc == LLVMMul) {
+            if (opc == LLVMAdd || opc == LLVMSub || opc == LLVMMul || opc == LLVMShl) {
                 LLVMValueRef op1 = LLVMGetOperand(i, 0);
                 if (reg_map.count(op1) && reg_map[op1] != -1 && live_range[op1].second == inst_index[i]) {
                     // Add the entry instru ->R to reg_map
                     reg_map[i] = reg_map[op1];
                     // if live rangeof second operand of i ends, and it has a physicla register P assigned...
                     LLVMValueRef op2 = LLVMGetOperand(i, 1);
-                    if (live_range.count(op1) && live_range[op2].second == inst_index[i]) {
+                    // not when op2 is op1, whose register i just took over
+                    if (op2 != op1 && live_range.count(op2) && live_range[op2].second == inst_index[i]) {
                         if (reg_map.count(op2) && reg_map[op2] != -1) available_regs.insert(reg_map[op2]);
                     }
+                    // nothing later in the block uses it, the register is free again
+                    if (live_range[i].second == inst_index[i]) available_regs.insert(reg_map[i]);
                     continue;
                 }
             }
@@ -129,13 +135,19 @@ void reg_alloc(LLVMValueRef func) {
                 reg_map[i] = R; // Add the entry instr-> R to regs_map
                 available_regs.erase(R);    // remove R from the available pool
                 freeRegs(i, available_regs);
+                // nothing later in the block uses it (e.g. a call whose value
+                // is dropped), R is free again right away
+                if (live_range[i].second == inst_index[i]) available_regs.insert(R);
             } 
             // if a physical register is not available
             else {
                 LLVMValueRef V = find_spill(i);
+                // no value live here holds a register, i goes to memory
+                if (V == NULL) reg_map[i] = -1;
                 // if V has more uses that instr
-                if (V != NULL) {
-                    if (live_range[i].second > live_range[V].second) {
+                else {
+                    // nor for a value nothing later uses
+                    if (live_range[i].second > live_range[V].second || live_range[i].second == inst_index[i]) {
                         reg_map[i] = -1;
                     } else {
                         int R = reg_map[V];
@@ -153,8 +165,137 @@ void reg_alloc(LLVMValueRef func) {
 }
 
 
+/*
+ * The register allocator works one block at a time and finds a spilled
+ * value's memory through the alloca it is stored to, which is how the
+ * alloca based builder leaves every local. Values from the SSA builder
+ * are brought back to that form first:
+ *  - a branch tests the flags its compare leaves, so a compare numbered
+ *    together with one from another block, or with work between it and
+ *    the branch, is built again right before the branch;
+ *  - a phi becomes an alloca that each predecessor stores its incoming
+ *    value to before branching, loaded where the phi was;
+ *  - a value used outside its own block is stored to an alloca right
+ *    after it is computed and loaded in front of each such use;
+ *  - the parameter, when used as anything but the value of a store, is
+ *    stored to an alloca at the top of the entry block and loaded at
+ *    each use.
+ * IR from the alloca based builder has none of these and is left alone.
+ */
+static LLVMValueRef newSlot(LLVMBuilderRef b, LLVMBasicBlockRef entry) {
+    LLVMPositionBuilderBefore(b, LLVMGetFirstInstruction(entry));
+    return LLVMBuildAlloca(b, LLVMInt32Type(), "");
+}
+
+// points the uses of v by user at a load of slot, placed right before the
+// use (at the end of the incoming block for a phi)
+static void loadAtUse(LLVMBuilderRef b, LLVMValueRef user, LLVMValueRef v, LLVMValueRef slot) {
+    int numOps = LLVMGetNumOperands(user);
+    for (int j = 0; j < numOps; j++) {
+        if (LLVMGetOperand(user, j) != v) continue;
+        if (LLVMIsAPHINode(user)) {
+            LLVMPositionBuilderBefore(b, LLVMGetBasicBlockTerminator(LLVMGetIncomingBlock(user, j)));
+        } else {
+            LLVMPositionBuilderBefore(b, user);
+        }
+        LLVMSetOperand(user, j, LLVMBuildLoad2(b, LLVMInt32Type(), slot, ""));
+    }
+}
+
+// each user once, in the order of its first use; the parameter of a long
+// function can have hundreds of thousands of them
+static void usersOf(LLVMValueRef v, vector<LLVMValueRef> &users) {
+    users.clear();
+    set<LLVMValueRef> seen;
+    for (LLVMUseRef u = LLVMGetFirstUse(v); u; u = LLVMGetNextUse(u)) {
+        LLVMValueRef user = LLVMGetUser(u);
+        if (seen.insert(user).second) users.push_back(user);
+    }
+}
+
+void demoteSSA(LLVMValueRef func) {
+    LLVMBasicBlockRef entry = LLVMGetFirstBasicBlock(func);
+    LLVMBuilderRef b = LLVMCreateBuilder();
+    vector<LLVMValueRef> users;
+
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        LLVMValueRef br = LLVMGetBasicBlockTerminator(bb);
+        if (!LLVMIsABranchInst(br) || !LLVMIsConditional(br)) continue;
+        LLVMValueRef cmp = LLVMGetCondition(br);
+        if (!LLVMIsAICmpInst(cmp) || LLVMGetPreviousInstruction(br) == cmp) continue;
+        LLVMPositionBuilderBefore(b, br);
+        LLVMSetCondition(br, LLVMBuildICmp(b, LLVMGetICmpPredicate(cmp),
+            LLVMGetOperand(cmp, 0), LLVMGetOperand(cmp, 1), ""));
+        if (!LLVMGetFirstUse(cmp)) LLVMInstructionEraseFromParent(cmp);
+    }
+
+    if (LLVMCountParams(func) > 0) {
+        LLVMValueRef param = LLVMGetParam(func, 0);
+        vector<LLVMValueRef> uses;
+        usersOf(param, users);
+        for (LLVMValueRef user : users) {
+            if (!LLVMIsAStoreInst(user) || LLVMGetOperand(user, 1) == param) uses.push_back(user);
+        }
+        if (!uses.empty()) {
+            LLVMValueRef slot = newSlot(b, entry);
+            LLVMValueRef at = LLVMGetFirstInstruction(entry);
+            while (LLVMIsAAllocaInst(at)) at = LLVMGetNextInstruction(at);
+            LLVMPositionBuilderBefore(b, at);
+            LLVMBuildStore(b, param, slot);
+            for (LLVMValueRef user : uses) loadAtUse(b, user, param, slot);
+        }
+    }
+
+    vector<LLVMValueRef> phis;
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i && LLVMIsAPHINode(i); i = LLVMGetNextInstruction(i)) {
+            phis.push_back(i);
+        }
+    }
+    for (LLVMValueRef phi : phis) {
+        LLVMValueRef slot = newSlot(b, entry);
+        unsigned n = LLVMCountIncoming(phi);
+        for (unsigned k = 0; k < n; k++) {
+            LLVMPositionBuilderBefore(b, LLVMGetBasicBlockTerminator(LLVMGetIncomingBlock(phi, k)));
+            LLVMBuildStore(b, LLVMGetIncomingValue(phi, k), slot);
+        }
+        LLVMValueRef at = LLVMGetFirstInstruction(LLVMGetInstructionParent(phi));
+        while (LLVMIsAPHINode(at)) at = LLVMGetNextInstruction(at);
+        LLVMPositionBuilderBefore(b, at);
+        LLVMReplaceAllUsesWith(phi, LLVMBuildLoad2(b, LLVMInt32Type(), slot, ""));
+        LLVMInstructionEraseFromParent(phi);
+    }
+
+    vector<LLVMValueRef> values;
+    for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+        for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i)) {
+            if (LLVMIsAAllocaInst(i) || LLVMGetTypeKind(LLVMTypeOf(i)) != LLVMIntegerTypeKind) continue;
+            for (LLVMUseRef u = LLVMGetFirstUse(i); u; u = LLVMGetNextUse(u)) {
+                if (LLVMGetInstructionParent(LLVMGetUser(u)) != bb) {
+                    values.push_back(i);
+                    break;
+                }
+            }
+        }
+    }
+    for (LLVMValueRef v : values) {
+        LLVMBasicBlockRef bb = LLVMGetInstructionParent(v);
+        usersOf(v, users);
+        LLVMValueRef slot = newSlot(b, entry);
+        LLVMPositionBuilderBefore(b, LLVMGetNextInstruction(v));
+        LLVMBuildStore(b, v, slot);
+        for (LLVMValueRef user : users) {
+            if (LLVMGetInstructionParent(user) != bb) loadAtUse(b, user, v, slot);
+        }
+    }
+
+    LLVMDisposeBuilder(b);
+}
+
+// numbered across the module, so no two functions share a label
+static int labelCount = 0;
+
 void createBBLabels(LLVMValueRef func) {
-    int labelCount = 0;
     for (LLVMBasicBlockRef b = LLVMGetFirstBasicBlock(func); b; b = LLVMGetNextBasicBlock(b)) {
         char* label = (char *)malloc(16);
         sprintf(label, ".L%d", labelCount++);
@@ -174,7 +315,38 @@ void printFunctionEnd(FILE *out) {
     fprintf(out, "\tret\n");
 }
 
+/* Whether v can be kept in slot instead of a place of its own when it is
+ * spilled. A spilled load is read from its slot, a spilled value is
+ * written there when it is computed, so the slot must hold v for as long
+ * as it is used: v is used in its own block only, the slot gets no other
+ * store before the last use, and is not read before v is stored there.
+ * Values reused by the optimizer can live well past the next store.
+ */
+static bool slotHolds(LLVMValueRef v, LLVMValueRef slot) {
+    LLVMBasicBlockRef bb = LLVMGetInstructionParent(v);
+    int uses = 0;
+    for (LLVMUseRef u = LLVMGetFirstUse(v); u; u = LLVMGetNextUse(u)) {
+        if (LLVMGetInstructionParent(LLVMGetUser(u)) != bb) return false;
+        uses++;
+    }
+    bool stored = LLVMIsALoadInst(v);
+    for (LLVMValueRef i = LLVMGetNextInstruction(v); i && uses > 0; i = LLVMGetNextInstruction(i)) {
+        if (LLVMIsAStoreInst(i) && LLVMGetOperand(i, 1) == slot) {
+            if (LLVMGetOperand(i, 0) != v) return false;
+            stored = true;
+        } else if (LLVMIsALoadInst(i) && LLVMGetOperand(i, 0) == slot && !stored) {
+            return false;
+        }
+        for (int k = 0; k < LLVMGetNumOperands(i); k++)
+            if (LLVMGetOperand(i, k) == v) uses--;
+    }
+    return true;
+}
+
 void getOffsetMap(LLVMValueRef func) {
+    // codegen ran this for every function already, start over so the
+    // slots below are counted in localMem again
+    offset_map.clear();
     // initialize localMem to 4
     localMem = 4;
     // if the function has param....
@@ -182,6 +354,14 @@ void getOffsetMap(LLVMValueRef func) {
     if (param) {
         offset_map[param] = 8;
     }
+    // a slot the parameter is stored to can be the parameter's own place
+    // only if nothing else is stored there
+    unordered_map<LLVMValueRef, int> stores;
+    for (LLVMBasicBlockRef b = LLVMGetFirstBasicBlock(func); b; b = LLVMGetNextBasicBlock(b)) {
+        for (LLVMValueRef i = LLVMGetFirstInstruction(b); i; i = LLVMGetNextInstruction(i)) {
+            if (LLVMIsAStoreInst(i)) stores[LLVMGetOperand(i, 1)]++;
+        }
+    }
     // for each basic block in the function
     for (LLVMBasicBlockRef b = LLVMGetFirstBasicBlock(func); b; b = LLVMGetNextBasicBlock(b)) {
         // for each instruction in the basic block
@@ -199,13 +379,15 @@ void getOffsetMap(LLVMValueRef func) {
                 LLVMValueRef Op2 = LLVMGetOperand(i, 1);
                 // if the first operand of the store instruction is equal to the function parameter
                 if (Op1 == param) {
+                    if (stores[Op2] > 1) continue;
                     // get the value associated with the first operand in offst_map. let thsi bne x
                     int x = offset_map[Op1];
                     // change the value associated with the second operand to x
                     offset_map[Op2] = x;
                 }
                 // if first operand of the store instruction is not equal to the function parameter and is not a constant
-                else if (!LLVMIsAConstant(Op1)) {
+                // (a load keeps the slot it was loaded from, which is where a spilled load is read)
+                else if (!LLVMIsAConstant(Op1) && !LLVMIsALoadInst(Op1) && slotHolds(Op1, Op2)) {
                     // get the value associated with the second operation in offset_map. let this be x
                     int x = offset_map[Op2];
                     // ad the first operand as th key with the associated value as x in offset_map
@@ -216,13 +398,24 @@ void getOffsetMap(LLVMValueRef func) {
             else if (LLVMIsALoadInst(i)) {
                 // get the value associated with the first operand. let this be x
                 LLVMValueRef Op1 = LLVMGetOperand(i, 0);
+                if (!slotHolds(i, Op1)) continue;
                 int x = offset_map[Op1];
                 // Add instr as the key with the associated value as x in the offset_map
                 offset_map[i] = x;
             }
         }
     }
-} 
+    // a spilled value that is never stored, e.g. one returned directly,
+    // still needs a slot of its own
+    for (LLVMBasicBlockRef b = LLVMGetFirstBasicBlock(func); b; b = LLVMGetNextBasicBlock(b)) {
+        for (LLVMValueRef i = LLVMGetFirstInstruction(b); i; i = LLVMGetNextInstruction(i)) {
+            if (LLVMGetTypeKind(LLVMTypeOf(i)) == LLVMIntegerTypeKind && reg_map.count(i) && reg_map[i] == -1 && !offset_map.count(i)) {
+                localMem += 4;
+                offset_map[i] = -localMem;
+            }
+        }
+    }
+}
 
 
 void generateAssembly(LLVMModuleRef Mod, FILE* out) {
@@ -273,20 +466,24 @@ void generateAssembly(LLVMModuleRef Mod, FILE* out) {
                 }
 
                 else if (opc == LLVMLoad) {
+                    int c = offset_map[LLVMGetOperand(Instr, 0)];
                     if (reg_map[Instr] != -1) {
-                        int c = offset_map[LLVMGetOperand(Instr, 0)];
                         fprintf(out, "\tmovl %d(%%ebp), %s\n", c, getRegName(reg_map[Instr]).c_str());
+                    } else if (offset_map[Instr] != c) {
+                        // spilled to a place of its own, see slotHolds
+                        fprintf(out, "\tmovl %d(%%ebp), %%eax\n", c);
+                        fprintf(out, "\tmovl %%eax, %d(%%ebp)\n", offset_map[Instr]);
                     }
                 }
 
                 else if (opc == LLVMStore) {
                     LLVMValueRef A = LLVMGetOperand(Instr, 0);
                     LLVMValueRef b_ptr = LLVMGetOperand(Instr, 1);
-                    if (A == LLVMGetParam(func, 0)) continue; 
+                    if (A == LLVMGetParam(func, 0) && offset_map[b_ptr] == offset_map[A]) continue; 
 
                     if (LLVMIsAConstantInt(A)) {
                         fprintf(out, "\tmovl $%ld, %d(%%ebp)\n", LLVMConstIntGetSExtValue(A), offset_map[b_ptr]);
-                    } else if (reg_map[A] != -1) {
+                    } else if (A != LLVMGetParam(func, 0) && reg_map[A] != -1) {
                         fprintf(out, "\tmovl %s, %d(%%ebp)\n", getRegName(reg_map[A]).c_str(), offset_map[b_ptr]);
                     } else {
                         fprintf(out, "\tmovl %d(%%ebp), %%eax\n", offset_map[A]);
@@ -316,6 +513,10 @@ void generateAssembly(LLVMModuleRef Mod, FILE* out) {
                 else if (opc == LLVMBr) {
                     if (!LLVMIsConditional(Instr)) {
                         fprintf(out, "\tjmp %s\n", bb_labels[LLVMValueAsBasicBlock(LLVMGetOperand(Instr, 0))].c_str());
+                    } else if (LLVMIsAConstantInt(LLVMGetOperand(Instr, 0))) {
+                        // a comparison of constants folded by the builder, operand 2 is the true target
+                        int taken = LLVMConstIntGetZExtValue(LLVMGetOperand(Instr, 0)) ? 2 : 1;
+                        fprintf(out, "\tjmp %s\n", bb_labels[LLVMValueAsBasicBlock(LLVMGetOperand(Instr, taken))].c_str());
                     } else {
                         string L1 = bb_labels[LLVMValueAsBasicBlock(LLVMGetOperand(Instr, 2))];
                         string L2 = bb_labels[LLVMValueAsBasicBlock(LLVMGetOperand(Instr, 1))];
@@ -331,7 +532,8 @@ void generateAssembly(LLVMModuleRef Mod, FILE* out) {
                     }
                 }
 
-                else if (opc == LLVMAdd || opc == LLVMSub || opc == LLVMMul || opc == LLVMICmp) {
+                // the optimizer only shifts by a constant, see Middlegg/combine.c
+                else if (opc == LLVMAdd || opc == LLVMSub || opc == LLVMMul || opc == LLVMShl || opc == LLVMICmp) {
                     LLVMValueRef A = LLVMGetOperand(Instr, 0);
                     LLVMValueRef B = LLVMGetOperand(Instr, 1);
                     string R = (reg_map[Instr] != -1) ? getRegName(reg_map[Instr]) : "%eax";
@@ -341,7 +543,7 @@ void generateAssembly(LLVMModuleRef Mod, FILE* out) {
                         if (getRegName(reg_map[A]) != R) fprintf(out, "\tmovl %s, %s\n", getRegName(reg_map[A]).c_str(), R.c_str());
                     } else fprintf(out, "\tmovl %d(%%ebp), %s\n", offset_map[A], R.c_str());
 
-                    string asmOp = (opc == LLVMAdd) ? "addl" : (opc == LLVMSub) ? "subl" : (opc == LLVMMul) ? "imull" : "cmpl";
+                    string asmOp = (opc == LLVMAdd) ? "addl" : (opc == LLVMSub) ? "subl" : (opc == LLVMMul) ? "imull" : (opc == LLVMShl) ? "shll" : "cmpl";
                     
                     if (LLVMIsAConstantInt(B)) fprintf(out, "\t%s $%ld, %s\n", asmOp.c_str(), LLVMConstIntGetSExtValue(B), R.c_str());
                     else if (reg_map[B] != -1) fprintf(out, "\t%s %s, %s\n", asmOp.c_str(), getRegName(reg_map[B]).c_str(), R.c_str());
@@ -372,6 +574,7 @@ void codegen(LLVMModuleRef *Mod, const char* filename) {
 
     for (LLVMValueRef func = LLVMGetFirstFunction(m); func; func = LLVMGetNextFunction(func)) {
         if (LLVMCountBasicBlocks(func) == 0) continue;
+        demoteSSA(func);
         createBBLabels(func);
         reg_alloc(func);
         getOffsetMap(func);
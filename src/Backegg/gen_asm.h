@@ -10,6 +10,7 @@
 #include <cstdio>
 #include <string>
 
+void demoteSSA(LLVMValueRef func);
 void reg_alloc(LLVMValueRef func);
 void compute_liveness(LLVMBasicBlockRef b);
 void get_inst_index(LLVMBasicBlockRef b);
@@ -0,0 +1,22 @@
+/*
+The actions of frontend.y call into stream.c for --stream, which needs
+the IR builder and LLVM. The benches link y.tab.c without them and never
+set stream_mode, so these do nothing and are never reached.
+*/
+#include "../ast/ast.h"
+#include "stream.h"
+
+bool stream_mode = false;
+
+void stream_begin(){}
+void stream_func_begin(symId name, astNode *param){}
+void stream_func_end(){}
+void stream_block_open(){}
+void stream_block_close(){}
+void stream_decl(astNode *decl){}
+void stream_stmt(astNode *node){}
+void stream_if_begin(astNode *cond){}
+void stream_if_else(){}
+void stream_if_end(){}
+void stream_while_begin(astNode *cond){}
+void stream_while_end(){}
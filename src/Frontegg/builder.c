@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "builder.h"
 #include "../ast/ast.h"
@@ -11,234 +12,438 @@
 #include <llvm-c/IRReader.h>
 #include <llvm-c/Types.h>
 #include <llvm-c/Target.h>
-#include <set>
 
 using namespace std;
 
-static size_t unique_id = 0;
-static unordered_map<string, string> name_map;
-static unordered_map<string, LLVMValueRef> var_map;
+static vector<LLVMValueRef> slot_refs; // alloca of each local, indexed by decl slot
 
 static LLVMModuleRef module;
 static LLVMBuilderRef builder;
-static LLVMValueRef ret_ref;
-static LLVMBasicBlockRef retBB;
-static LLVMValueRef func_print;
-static LLVMValueRef func_read;
-
+static LLVMBasicBlockRef entry_block;
+static LLVMValueRef last_alloca;
+
+/*
+ * The blocks that leave the function and the value each returns (NULL
+ * where the body just ends). A return does not branch anywhere when it
+ * is built, end_function emits a ret right there when it is the only
+ * exit and joins the exits in a retBB otherwise. The statements after a
+ * return are not built, the current block is NULL until the end of the
+ * enclosing if or while.
+ */
+static vector<pair<LLVMBasicBlockRef, LLVMValueRef>> exits;
+static size_t ir_blocks, ir_instructions;
+
+/*
+ * Values of hash-consed nodes already built in the current block. The
+ * frontend gives an expression a new node after each assignment to one
+ * of its variables, so within one block a shared node always has the
+ * same value. Other blocks may be reached along paths that assign in
+ * between, so the memo only lives as long as the block.
+ */
+static unordered_map<astNode*, LLVMValueRef> shared_values;
+static LLVMBasicBlockRef shared_block = NULL;
+
+/*
+ * SSA mode builds the values of the locals directly, after Braun et al.,
+ * "Simple and Efficient Construction of Static Single Assignment Form":
+ * an assignment records the value as the variable's definition in the
+ * current block and a read looks the definition up, through the
+ * predecessors if the block has none. A block with several predecessors
+ * gets a phi. Blocks are sealed once all their predecessors are known;
+ * that is at creation except for a loop's condBB (sealed after the back
+ * edge) and the falseBB of an if (after the if body). A read in a block
+ * that is not sealed yet leaves an empty phi that is completed at
+ * sealing. Phis whose operands are all one value are replaced by that
+ * value.
+ *
+ * Variables are indexed by their decl slot + 1, 0 is the return value.
+ */
+bool ssa_mode = false;
+
+static const int ret_var = 0;
+
+typedef struct {
+    bool sealed;
+    vector<pair<int, LLVMValueRef>> incomplete; // phis to complete at sealing
+} ssa_block;
+
+typedef struct {
+    LLVMBasicBlockRef bb;
+    LLVMValueRef phi;            // NULL when bb has one predecessor
+    vector<LLVMBasicBlockRef> preds;
+    size_t next;                 // predecessor being looked up
+} ssa_frame;
+
+static vector<unordered_map<LLVMBasicBlockRef, LLVMValueRef>> ssa_defs; // per variable
+static unordered_map<LLVMBasicBlockRef, ssa_block> ssa_blocks;
+static unordered_map<LLVMValueRef, LLVMValueRef> ssa_replaced; // trivial phi -> its value
+static vector<LLVMValueRef> ssa_removed;   // trivial phis, erased with the function
+static unordered_set<LLVMValueRef> ssa_filling; // phis still getting their operands
+static vector<ssa_frame> ssa_stack;
+
+static int ssa_var(int slot) {
+    return slot + 1;
+}
 
-char* to_ast_str(string s) {
-    return strdup(s.c_str());
+static LLVMValueRef ssa_resolve(LLVMValueRef v) {
+    unordered_map<LLVMValueRef, LLVMValueRef>::iterator it;
+    while ((it = ssa_replaced.find(v)) != ssa_replaced.end()) v = it->second;
+    return v;
 }
 
-string gen_unique_name(string var_name, size_t level) {
-    return var_name + "." + to_string(level) + "." + to_string(unique_id++);
+static void ssa_write(int var, LLVMBasicBlockRef bb, LLVMValueRef value) {
+    if ((size_t) var >= ssa_defs.size()) ssa_defs.resize(var + 1);
+    ssa_defs[var][bb] = value;
 }
 
-void rename_ast(astNode *root, const char* output_file) {
-    if (!root) return;
-    unique_id = 0;
-    name_map.clear();
-    process(root, 0);
-    build(root);
-    //LLVMDumpModule(module);
-    LLVMPrintModuleToFile(module, output_file, NULL);
-    LLVMDisposeBuilder(builder);
-    LLVMDisposeModule(module);
+static LLVMValueRef ssa_lookup(int var, LLVMBasicBlockRef bb) {
+    if ((size_t) var >= ssa_defs.size()) return NULL;
+    unordered_map<LLVMBasicBlockRef, LLVMValueRef>::iterator it = ssa_defs[var].find(bb);
+    return it == ssa_defs[var].end() ? NULL : ssa_resolve(it->second);
 }
 
-void process(astNode *node, size_t level) {
-    if (!node) return;
+static void ssa_unsealed(LLVMBasicBlockRef bb) {
+    ssa_blocks[bb].sealed = false;
+}
 
-    switch(node->type) {
-        case ast_prog:
-            process(node->prog.func, level);
-            break;
+static bool ssa_is_sealed(LLVMBasicBlockRef bb) {
+    unordered_map<LLVMBasicBlockRef, ssa_block>::iterator it = ssa_blocks.find(bb);
+    return it == ssa_blocks.end() || it->second.sealed;
+}
 
-        case ast_func:
-            if (node->func.param) process(node->func.param, level);
-            process(node->func.body, level + 1);
-            break;
+// the blocks whose terminators branch to bb
+static void ssa_preds(LLVMBasicBlockRef bb, vector<LLVMBasicBlockRef> &preds) {
+    preds.clear();
+    for (LLVMUseRef u = LLVMGetFirstUse(LLVMBasicBlockAsValue(bb)); u; u = LLVMGetNextUse(u))
+        preds.push_back(LLVMGetInstructionParent(LLVMGetUser(u)));
+}
 
-        case ast_stmt:
-            processStmt(&(node->stmt), level);
-            break;
+static LLVMValueRef ssa_new_phi(LLVMBasicBlockRef bb) {
+    LLVMBasicBlockRef at = LLVMGetInsertBlock(builder);
+    LLVMValueRef first = LLVMGetFirstInstruction(bb);
+    if (first) LLVMPositionBuilderBefore(builder, first);
+    else LLVMPositionBuilderAtEnd(builder, bb);
+    LLVMValueRef phi = LLVMBuildPhi(builder, LLVMInt32Type(), "");
+    LLVMPositionBuilderAtEnd(builder, at);
+    return phi;
+}
 
-        case ast_var: {
-            if (name_map.count(node->var.name)) {
-                char* old_name = node->var.name;
-                node->var.name = to_ast_str(name_map[old_name]);
-                free(old_name); 
+// replaces phi by its only operand if it has one, phis using it are
+// checked again; returns what phi stands for now
+static LLVMValueRef ssa_remove_trivial(LLVMValueRef phi) {
+    vector<LLVMValueRef> work(1, phi);
+    while (!work.empty()) {
+        LLVMValueRef p = work.back();
+        work.pop_back();
+        if (ssa_replaced.count(p) || ssa_filling.count(p)) continue;
+        LLVMValueRef same = NULL;
+        bool trivial = true;
+        for (unsigned i = 0; i < LLVMCountIncoming(p); i++) {
+            LLVMValueRef v = LLVMGetIncomingValue(p, i);
+            if (v == same || v == p) continue;
+            if (same != NULL) {
+                trivial = false;
+                break;
             }
-            break;
+            same = v;
         }
-        case ast_rexpr:
-            process(node->rexpr.lhs, level);
-            process(node->bexpr.rhs, level);
-            break;
-        case ast_bexpr:
-            process(node->bexpr.lhs, level);
-            process(node->bexpr.rhs, level);
-            break;
-
-        case ast_uexpr:
-            process(node->uexpr.expr, level);
-            break;
-
-        default: break; 
+        if (!trivial) continue;
+        // only reachable from itself: the variable was never assigned
+        if (same == NULL) same = LLVMConstInt(LLVMInt32Type(), 0, 0);
+        for (LLVMUseRef u = LLVMGetFirstUse(p); u; u = LLVMGetNextUse(u)) {
+            LLVMValueRef user = LLVMGetUser(u);
+            if (user != p && LLVMIsAPHINode(user)) work.push_back(user);
+        }
+        LLVMReplaceAllUsesWith(p, same);
+        ssa_replaced[p] = same;
+        ssa_removed.push_back(p);
     }
+    return ssa_resolve(phi);
 }
 
-void processStmt(astStmt *stmt, size_t level) {
-    if (!stmt) return;
-
-    switch(stmt->type) {
-        case ast_decl: {
-            string unique = gen_unique_name(stmt->decl.name, level);
-            name_map[stmt->decl.name] = unique;
-            
-            char* old_name = stmt->decl.name;
-            stmt->decl.name = to_ast_str(unique);
-            free(old_name);
-            break;
+/*
+ * The value of var at the end of bb. The lookup through the predecessors
+ * keeps its own stack, a chain of blocks can be as long as the function.
+ */
+static LLVMValueRef ssa_read(int var, LLVMBasicBlockRef bb) {
+    LLVMValueRef val = ssa_lookup(var, bb);
+    if (val != NULL) return val;
+    ssa_stack.clear();
+    for (;;) {
+        // walk up until a block knows var or has to give it a phi
+        for (;;) {
+            val = ssa_lookup(var, bb);
+            if (val != NULL) break;
+            if (!ssa_is_sealed(bb)) {
+                val = ssa_new_phi(bb);
+                ssa_blocks[bb].incomplete.push_back(make_pair(var, val));
+                ssa_write(var, bb, val);
+                break;
+            }
+            ssa_frame f;
+            f.bb = bb;
+            f.phi = NULL;
+            f.next = 0;
+            ssa_preds(bb, f.preds);
+            if (f.preds.empty()) {
+                // entry or unreachable code: read before any assignment
+                val = LLVMConstInt(LLVMInt32Type(), 0, 0);
+                ssa_write(var, bb, val);
+                break;
+            }
+            if (f.preds.size() > 1) {
+                // written first, so a loop back to bb finds the phi
+                f.phi = ssa_new_phi(bb);
+                ssa_write(var, bb, f.phi);
+                ssa_filling.insert(f.phi);
+            }
+            bb = f.preds[0];
+            ssa_stack.push_back(f);
         }
-
-        case ast_block: {
-            vector<astNode*> *slist = stmt->block.stmt_list;
-            for (size_t i = 0; i < slist->size(); i++) {
-                process((*slist)[i], level);
+        // hand val back down until a phi has predecessors left
+        while (!ssa_stack.empty()) {
+            ssa_frame &f = ssa_stack.back();
+            if (f.phi == NULL) {
+                ssa_write(var, f.bb, val);
+                ssa_stack.pop_back();
+                continue;
             }
-            break;
+            LLVMValueRef v = ssa_resolve(val);
+            LLVMBasicBlockRef from = f.preds[f.next++];
+            LLVMAddIncoming(f.phi, &v, &from, 1);
+            if (f.next < f.preds.size()) break;
+            ssa_filling.erase(f.phi);
+            val = ssa_remove_trivial(f.phi);
+            ssa_write(var, f.bb, val);
+            ssa_stack.pop_back();
         }
+        if (ssa_stack.empty()) return ssa_resolve(val);
+        bb = ssa_stack.back().preds[ssa_stack.back().next];
+    }
+}
 
-        case ast_asgn:
-            process(stmt->asgn.lhs, level);
-            process(stmt->asgn.rhs, level);
-            break;
+// all predecessors of bb are there, completes the phis read there so far
+static void ssa_seal(LLVMBasicBlockRef bb) {
+    vector<pair<int, LLVMValueRef>> phis;
+    phis.swap(ssa_blocks[bb].incomplete);
+    ssa_blocks[bb].sealed = true;
+    vector<LLVMBasicBlockRef> preds;
+    ssa_preds(bb, preds);
+    for (size_t i = 0; i < phis.size(); i++) {
+        LLVMValueRef phi = phis[i].second;
+        ssa_filling.insert(phi);
+        for (LLVMBasicBlockRef pred : preds) {
+            LLVMValueRef v = ssa_read(phis[i].first, pred);
+            LLVMAddIncoming(phi, &v, &pred, 1);
+        }
+        ssa_filling.erase(phi);
+        ssa_remove_trivial(phi);
+    }
+}
 
-        case ast_if:
-            process(stmt->ifn.cond, level);
-            process(stmt->ifn.if_body, level);
-            if (stmt->ifn.else_body) process(stmt->ifn.else_body, level);
-            break;
+static void ssa_reset() {
+    ssa_defs.clear();
+    ssa_blocks.clear();
+    ssa_replaced.clear();
+    ssa_removed.clear();
+    ssa_filling.clear();
+}
 
-        case ast_while:
-            process(stmt->whilen.cond, level);
-            process(stmt->whilen.body, level);
-            break;
+static void ssa_end_function() {
+    for (LLVMValueRef phi : ssa_removed) LLVMInstructionEraseFromParent(phi);
+    ssa_reset();
+}
 
-        case ast_ret:
-            process(stmt->ret.expr, level);
-            break;
 
-        case ast_call:
-            if (stmt->call.param) process(stmt->call.param, level);
-            break;
+/*
+ * Pieces of build shared with the streaming mode below, which builds the
+ * same module one statement at a time.
+ */
+static void begin_module() {
+    // Generate a module, set the target architecture
+    module = LLVMModuleCreateWithName("module");
+    LLVMSetTarget(module, "x86_64-pc-linux-gnu");
+
+    // generate llvm functions without bodies for print and 
+    // read extern function declarations; calls find them, like the
+    // functions of the program, by name
+    LLVMTypeRef ret_read = LLVMFunctionType(LLVMInt32Type(), NULL, 0, 0);
+    LLVMAddFunction(module, "read", ret_read);
+
+    LLVMTypeRef param_print[] = {LLVMInt32Type()};
+    LLVMTypeRef ret_print = LLVMFunctionType(LLVMVoidType(), param_print, 1, 0);
+    LLVMAddFunction(module, "print", ret_print);
+}
 
-        default: break;
+// hands the module over, the builder is done with it
+static LLVMModuleRef finish_module() {
+    ir_blocks = ir_instructions = 0;
+    for (LLVMValueRef func = LLVMGetFirstFunction(module); func; func = LLVMGetNextFunction(func)) {
+        for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+            ir_blocks++;
+            for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i)) ir_instructions++;
+        }
     }
+    LLVMDisposeBuilder(builder);
+    return module;
 }
 
-void collectAllNames(astNode* node, set<string>& names) {
-    if (!node) return;
+irStats builderCounts() {
+    irStats c = {ir_blocks, ir_instructions};
+    return c;
+}
 
-    if (node->type == ast_stmt) {
-        if (node->stmt.type == ast_decl) names.insert(node->stmt.decl.name);
-        else if (node->stmt.type == ast_block) {
-            for(auto n : *(node->stmt.block.stmt_list)) collectAllNames(n, names);
-        }
-        else if(node->stmt.type == ast_if) {
-            collectAllNames(node->stmt.ifn.if_body, names);
-            if (node->stmt.ifn.else_body) collectAllNames(node->stmt.ifn.else_body, names);
-        }
-        else if (node->stmt.type == ast_while) collectAllNames(node->stmt.whilen.body, names);
+// creates the function with its entry block, the builder is left at
+// the end of it
+static LLVMBasicBlockRef begin_function(const char *name, bool has_param) {
+    // creating function in a module
+    vector<LLVMTypeRef> p_types;
+    if (has_param) p_types.push_back(LLVMInt32Type());
+    LLVMTypeRef func_type = LLVMFunctionType(LLVMInt32Type(), p_types.data(), p_types.size(), 0);
+    LLVMValueRef func = LLVMAddFunction(module, name, func_type);
+
+    // generate a llvm builder
+    builder = LLVMCreateBuilder();
+    // generate a entry basic block, and let entryBB be the ref to this bb
+    LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(func, "entryBB");
+    // set the position of builder to the end of entryBB
+    LLVMPositionBuilderAtEnd(builder, entryBB);
+    entry_block = entryBB;
+    last_alloca = NULL;
+    exits.clear();
+    slot_refs.clear();
+    shared_values.clear();
+    shared_block = NULL;
+    return entryBB;
+}
+
+// allocas go to the top of the entry block, in the order they are made
+static LLVMValueRef build_alloca(const char *name) {
+    LLVMValueRef at = last_alloca ? LLVMGetNextInstruction(last_alloca) : LLVMGetFirstInstruction(entry_block);
+    if (at) LLVMPositionBuilderBefore(builder, at);
+    else LLVMPositionBuilderAtEnd(builder, entry_block);
+    last_alloca = LLVMBuildAlloca(builder, LLVMInt32Type(), name);
+    return last_alloca;
+}
+
+// generates the alloca of a local, in slot order; the builder is left at
+// the end of block bb (NULL for a declaration after a return)
+static void add_local(astNode *decl, LLVMBasicBlockRef bb) {
+    if (ssa_mode) return;
+    int slot = decl->stmt.decl.slot;
+    if ((size_t) slot >= slot_refs.size()) slot_refs.resize(slot + 1, NULL);
+    slot_refs[slot] = build_alloca(decl->stmt.decl.name);
+    if (bb != NULL) LLVMPositionBuilderAtEnd(builder, bb);
+}
+
+static void store_param(astNode *param, LLVMBasicBlockRef entryBB) {
+    // generate a store instruction to store the function parameter(user LLVMGetParam) into
+        // the memory location with (alloc instruction) the prameter name in the function ast node.
+    LLVMValueRef func = LLVMGetBasicBlockParent(entryBB);
+    if (ssa_mode) {
+        ssa_write(ssa_var(param->stmt.decl.slot), entryBB, LLVMGetParam(func, 0));
+        return;
     }
+    LLVMBuildStore(builder, LLVMGetParam(func, 0), slot_refs[param->stmt.decl.slot]);
 }
 
-void build(astNode *node) {
+// exitBB is where the body ends, NULL if every path returns before
+static void end_function(LLVMBasicBlockRef exitBB) {
+    if (exitBB != NULL) exits.push_back(make_pair(exitBB, (LLVMValueRef) NULL));
+    LLVMValueRef func = LLVMGetBasicBlockParent(entry_block);
+
+    if (exits.size() == 1) {
+        // a single exit returns directly; falling off the end gives 0
+        LLVMValueRef v = exits[0].second;
+        LLVMPositionBuilderAtEnd(builder, exits[0].first);
+        LLVMBuildRet(builder, v ? v : LLVMConstInt(LLVMInt32Type(), 0, 0));
+    } else if (!exits.empty()) {
+        // the exits meet in retBB, through the memory of ret_ref or a phi
+        LLVMValueRef ret_ref = ssa_mode ? NULL : build_alloca("ret_ref");
+        LLVMBasicBlockRef retBB = LLVMAppendBasicBlock(func, "retBB");
+        for (size_t i = 0; i < exits.size(); i++) {
+            LLVMValueRef v = exits[i].second ? exits[i].second : LLVMConstInt(LLVMInt32Type(), 0, 0);
+            LLVMPositionBuilderAtEnd(builder, exits[i].first);
+            if (ssa_mode) ssa_write(ret_var, exits[i].first, v);
+            else LLVMBuildStore(builder, v, ret_ref);
+            LLVMBuildBr(builder, retBB);
+        }
+        LLVMPositionBuilderAtEnd(builder, retBB);
+        if (ssa_mode) LLVMBuildRet(builder, ssa_read(ret_var, retBB));
+        else LLVMBuildRet(builder, LLVMBuildLoad2(builder, LLVMInt32Type(), ret_ref, "val"));
+    }
+    if (ssa_mode) ssa_end_function();
+}
 
-	switch(node->type) {
-		case ast_prog: {
-            // Generate a module, set the target architecture
-            module = LLVMModuleCreateWithName("module");
-            LLVMSetTarget(module, "x86_64-pc-linux-gnu");
+/*
+ * Ends of ifs and whiles, shared with the streaming mode. Each takes the
+ * block the body ended in, NULL if it returned on every path, and gives
+ * the block the statements after it go to.
+ */
+static LLVMBasicBlockRef end_while(LLVMBasicBlockRef bodyExitBB, LLVMBasicBlockRef condBB, LLVMBasicBlockRef falseBB) {
+    if (bodyExitBB != NULL) {
+        LLVMPositionBuilderAtEnd(builder, bodyExitBB);
+        LLVMBuildBr(builder, condBB);
+    }
+    if (ssa_mode) ssa_seal(condBB);
+    return falseBB;
+}
 
-            // generate llvm functions without bodies for print and 
-            // read extern function declarations
-            LLVMTypeRef ret_read = LLVMFunctionType(LLVMInt32Type(), NULL, 0, 0);
-            func_read = LLVMAddFunction(module, "read", ret_read);
+// an if without else: falseBB is where the statements after it go
+static LLVMBasicBlockRef end_if(LLVMBasicBlockRef ifExitBB, LLVMBasicBlockRef falseBB) {
+    if (ifExitBB != NULL) {
+        LLVMPositionBuilderAtEnd(builder, ifExitBB);
+        LLVMBuildBr(builder, falseBB);
+    }
+    if (ssa_mode) ssa_seal(falseBB);
+    return falseBB;
+}
 
-            LLVMTypeRef param_print[] = {LLVMInt32Type()};
-            LLVMTypeRef ret_print = LLVMFunctionType(LLVMVoidType(), param_print, 1, 0);
-            func_print = LLVMAddFunction(module, "print", ret_print);
+// an if with else: when only one arm falls through, its block simply
+// continues, only two arms get an endBB to meet in
+static LLVMBasicBlockRef end_if_else(LLVMBasicBlockRef ifExitBB, LLVMBasicBlockRef elseExitBB) {
+    if (ifExitBB == NULL) return elseExitBB;
+    if (elseExitBB == NULL) return ifExitBB;
+    LLVMValueRef func = LLVMGetBasicBlockParent(ifExitBB);
+    LLVMBasicBlockRef endBB = LLVMAppendBasicBlock(func, "endBB");
+    LLVMPositionBuilderAtEnd(builder, ifExitBB); LLVMBuildBr(builder, endBB);
+    LLVMPositionBuilderAtEnd(builder, elseExitBB); LLVMBuildBr(builder, endBB);
+    return endBB;
+}
 
+LLVMModuleRef rename_ast(astNode *root) {
+    if (!root) return NULL;
+    // semantic_analysis has already resolved every variable to its
+    // declaration's slot and collected the locals of each function
+    build(root);
+    return finish_module();
+}
 
+void build(astNode *node) {
 
-            // visit the function node
-            build(node->prog.func);
+	switch(node->type) {
+		case ast_prog: {
+            begin_module();
+            // visit the function nodes, a function only calls the ones before it
+            for (astNode *func = node->prog.func; func != NULL; func = func->func.next)
+                build(func);
             break;
        }
         case ast_func: {
-            // creating function in a module
-            vector<LLVMTypeRef> p_types;
-            if (node->func.param) p_types.push_back(LLVMInt32Type());
-            LLVMTypeRef func_type = LLVMFunctionType(LLVMInt32Type(), p_types.data(), p_types.size(), 0);
-            LLVMValueRef func = LLVMAddFunction(module, node->func.name, func_type);
-
-           // generate a llvm builder
-           builder = LLVMCreateBuilder();
-           // generate a entry basic block, and let entryBB be the ref to this bb
-           LLVMBasicBlockRef entryBB = LLVMAppendBasicBlock(func, "entryBB");
-           // create a set with names of all parameters and loca variables
-           set<string> param_names;
-           set<string> all_names;
-           if (node->func.param != NULL) {
-               collectAllNames(node->func.param, param_names);
-               collectAllNames(node->func.param, all_names);
+            LLVMBasicBlockRef entryBB = begin_function(node->func.name, node->func.param != NULL);
+            // generate an alloca for the parameter and every local, semantic
+            // analysis collected them in slot order
+            for (astNode *decl : *node->func.locals) {
+                add_local(decl, entryBB);
             }
-           collectAllNames(node->func.body, all_names);
-           // set the position of builder to the end of entryBB
-           LLVMPositionBuilderAtEnd(builder, entryBB);
-           // initialize var_map to a new map;
-           var_map.clear();
-           // for each names in the set created above:
-            for(auto& name : all_names) {
-                // generate an allocstatement
-                // Add names llvmvalueref to alloc statement generated above to var_map
-                var_map[name] = LLVMBuildAlloca(builder, LLVMInt32Type(), name.c_str()); 
-           }
-
-            // generate an alloc instruction for the return value nad keep the llvmvalue ref, ret_ref,
-            // of this instruction available everywhere in your program
-            ret_ref = LLVMBuildAlloca(builder, LLVMInt32Type(), "ret_ref");
-            // generate a store instruction to store the function parameter(user LLVMGetParam) into
-                // the memory location with (alloc instruction) the prameter name in the function ast node.
-            if (param_names.size() > 0) {
-                for(const std::string& name : param_names) {
-                    LLVMBuildStore(builder, LLVMGetParam(func, 0), var_map[name]);
-                }
+            if (node->func.param != NULL) {
+                store_param(node->func.param, entryBB);
             }
 
-            // generate a return basic block and keep the llvmbasicblockref, retbb, of this basic
-            // block available everywhere in your program
-            retBB = LLVMAppendBasicBlock(func, "retBB");
-            // set the position of the builde to then end of retBB
-            LLVMPositionBuilderAtEnd(builder, retBB);
-            // Add the folowing LLVM instructions to retbb
-                // A load instruction from the ret_ref
-                // A return instruction with operand as the load instruction created above
-            LLVMValueRef r1_load = LLVMBuildLoad2(builder, LLVMInt32Type(), ret_ref, "val");
-            LLVMBuildRet(builder, r1_load);
-
             // Generate the IR for the function body by call genIRstmt subroutine given below: pass entryBB as a param
             // to genIRStmt and let the exitBB be the return value of genIRStmt call
             LLVMBasicBlockRef exitBB = genIRStmt(node->func.body, entryBB);
-            // get the terminator instruction of exitBB basic block
-            // if the termina is NULL( there is no return statement at the end of the function body)
-            if (LLVMGetBasicBlockTerminator(exitBB) == NULL) {
-                LLVMPositionBuilderAtEnd(builder, exitBB);
-                LLVMBuildBr(builder, retBB);
-            }
+            end_function(exitBB);
             break;
 
        }
@@ -247,107 +452,194 @@ void build(astNode *node) {
 
 }
 
+/*
+ * genIRStmt and genIRExpr walk the tree with explicit stacks so deeply
+ * nested statements and long expression chains do not overflow the
+ * native stack. A statement frame records how far the statement got:
+ * a while or if frame is revisited after each of its bodies, with the
+ * block the body ended in as the current block. After a return there is
+ * no current block and statements are skipped until a join is reached.
+ */
+typedef struct {
+    astNode *node;
+    int state;               // 0 on the first visit
+    size_t next;             // next statement of a block
+    LLVMBasicBlockRef condBB; // while: block of the condition
+    LLVMBasicBlockRef falseBB;
+    LLVMBasicBlockRef ifExitBB;
+} stmt_frame;
+
+typedef struct {
+    astNode *node;
+    bool operands_done;
+} expr_frame;
+
+static vector<stmt_frame> stmt_stack;
+static vector<expr_frame> expr_stack;
+static vector<LLVMValueRef> value_stack;
+
+static void push_stmt(astNode *node) {
+    stmt_frame f = {node, 0, 0, NULL, NULL, NULL};
+    stmt_stack.push_back(f);
+}
+
 LLVMBasicBlockRef genIRStmt(astNode *node, LLVMBasicBlockRef startBB) {
 
-    if (!node) return startBB;
-    LLVMPositionBuilderAtEnd(builder, startBB);
+    if (!node || !startBB) return startBB;
     LLVMValueRef func = LLVMGetBasicBlockParent(startBB);
+    // the block the statements generated so far ended in
+    LLVMBasicBlockRef curBB = startBB;
+
+    stmt_stack.clear();
+    push_stmt(node);
+    while (!stmt_stack.empty()) {
+        stmt_frame &f = stmt_stack.back();
+        if (f.node == NULL) {
+            stmt_stack.pop_back();
+            continue;
+        }
+        if (f.state == 0) {
+            // unreachable, a return came before it
+            if (curBB == NULL) {
+                stmt_stack.pop_back();
+                continue;
+            }
+            LLVMPositionBuilderAtEnd(builder, curBB);
+        }
+        if (f.node->type != ast_stmt) {
+            // an expression statement, built for the calls in it
+            genIRExpr(f.node);
+            stmt_stack.pop_back();
+            continue;
+        }
 
-    if (node->type == ast_stmt) {
-        astStmt *s = &(node->stmt);
+        astStmt *s = &(f.node->stmt);
         switch(s->type) {
             case ast_asgn: {
                 LLVMValueRef rhs = genIRExpr(s->asgn.rhs);
-                LLVMBuildStore(builder, rhs, var_map[s->asgn.lhs->var.name]);
-                return startBB;
+                if (ssa_mode) ssa_write(ssa_var(s->asgn.lhs->var.slot), curBB, rhs);
+                else LLVMBuildStore(builder, rhs, slot_refs[s->asgn.lhs->var.slot]);
+                stmt_stack.pop_back();
+                break;
            }
             case ast_call: {
-                LLVMValueRef val = genIRExpr(s->call.param);
-                LLVMTypeRef param_print[] = {LLVMInt32Type()};
-                LLVMTypeRef ret_print = LLVMFunctionType(LLVMVoidType(), param_print, 1, 0);
-                LLVMBuildCall2(builder, ret_print, func_print, &val, 1, "");
-                return startBB;
+                // print, or a call whose value is dropped
+                genIRExpr(f.node);
+                stmt_stack.pop_back();
+                break;
            }
             case ast_while: {
-                
-                LLVMBasicBlockRef condBB = LLVMAppendBasicBlock(func, "condBB");
-                LLVMBuildBr(builder, condBB);
-
-                LLVMPositionBuilderAtEnd(builder, condBB);
-                LLVMValueRef condVal = genIRExpr(s->whilen.cond);
-                LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
-                LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
-
-                LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
-
-                LLVMBasicBlockRef trueXitBB = genIRStmt(s->whilen.body, trueBB);
-                LLVMPositionBuilderAtEnd(builder, trueXitBB);
-                LLVMBuildBr(builder, condBB);
-                return falseBB;
+                if (f.state == 0) {
+                    LLVMBasicBlockRef condBB = LLVMAppendBasicBlock(func, "condBB");
+                    LLVMBuildBr(builder, condBB);
+                    // the back edge comes after the body
+                    if (ssa_mode) ssa_unsealed(condBB);
+
+                    LLVMPositionBuilderAtEnd(builder, condBB);
+                    LLVMValueRef condVal = genIRExpr(s->whilen.cond);
+                    LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
+                    LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
+
+                    LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
+
+                    // generate the body into trueBB, then come back here
+                    f.condBB = condBB;
+                    f.falseBB = falseBB;
+                    f.state = 1;
+                    curBB = trueBB;
+                    push_stmt(s->whilen.body);
+                } else {
+                    curBB = end_while(curBB, f.condBB, f.falseBB);
+                    stmt_stack.pop_back();
+                }
+                break;
             }
             case ast_if: {
-                LLVMValueRef condVal = genIRExpr(s->ifn.cond);
-                LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
-                LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
-                LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
-                if (s->ifn.else_body == NULL) {
-                    LLVMBasicBlockRef ifExitBB = genIRStmt(s->ifn.if_body, trueBB);
-                    LLVMPositionBuilderAtEnd(builder, ifExitBB);
-                    LLVMBuildBr(builder, falseBB);
-                    return falseBB;
+                if (f.state == 0) {
+                    LLVMValueRef condVal = genIRExpr(s->ifn.cond);
+                    LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
+                    LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
+                    LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
+                    // without an else, the if body branches to falseBB too
+                    if (ssa_mode) ssa_unsealed(falseBB);
+                    f.falseBB = falseBB;
+                    f.state = 1;
+                    curBB = trueBB;
+                    push_stmt(s->ifn.if_body);
+                } else if (f.state == 1 && s->ifn.else_body == NULL) {
+                    curBB = end_if(curBB, f.falseBB);
+                    stmt_stack.pop_back();
+                } else if (f.state == 1) {
+                    // the if body ended in curBB, now the else body
+                    if (ssa_mode) ssa_seal(f.falseBB);
+                    f.ifExitBB = curBB;
+                    f.state = 2;
+                    curBB = f.falseBB;
+                    push_stmt(s->ifn.else_body);
                 } else {
-                    LLVMBasicBlockRef ifExitBB = genIRStmt(s->ifn.if_body, trueBB);
-                    LLVMBasicBlockRef elseExitBB = genIRStmt(s->ifn.else_body, falseBB);
-                    LLVMBasicBlockRef endBB = LLVMAppendBasicBlock(func, "endBB");
-
-                    LLVMPositionBuilderAtEnd(builder, ifExitBB); LLVMBuildBr(builder, endBB);
-                    LLVMPositionBuilderAtEnd(builder, elseExitBB); LLVMBuildBr(builder, endBB);
-                    return endBB;
+                    curBB = end_if_else(f.ifExitBB, curBB);
+                    stmt_stack.pop_back();
                 }
+                break;
              }
             case ast_block: {
-                LLVMBasicBlockRef prevBB = startBB;
-                for (auto n : *(s->block.stmt_list)) {
-                    prevBB = genIRStmt(n, prevBB);
+                // each statement starts in the block the previous one ended in
+                astList *slist = s->block.stmt_list;
+                f.state = 1;
+                if (f.next < slist->size() && curBB != NULL) {
+                    push_stmt((*slist)[f.next++]);
+                } else {
+                    stmt_stack.pop_back();
                 }
-                return prevBB;
+                break;
             }
             case ast_ret: {
                 LLVMValueRef retval = genIRExpr(s->ret.expr);
-                LLVMBuildStore(builder, retval, ret_ref);
-                LLVMBuildBr(builder, retBB);
-                return LLVMAppendBasicBlock(func, "afterRetBB");
+                exits.push_back(make_pair(curBB, retval));
+                curBB = NULL;
+                stmt_stack.pop_back();
+                break;
           }
-            default: return startBB;
+            default:
+                stmt_stack.pop_back();
+                break;
 
         }
     }
-    return startBB;
+    return curBB;
 }
 
-LLVMValueRef genIRExpr(astNode *node) {
+static LLVMValueRef pop_value() {
+    LLVMValueRef v = value_stack.back();
+    value_stack.pop_back();
+    return v;
+}
+
+// builds the instruction of a single expression node, its operands are
+// on top of value_stack
+static LLVMValueRef genIRNode(astNode *node) {
 
-    if (!node) return NULL;
     switch(node->type) {
         case ast_cnst:
             return LLVMConstInt(LLVMInt32Type(), node->cnst.value, 0);
         case ast_var:
-            return LLVMBuildLoad2(builder, LLVMInt32Type(), var_map[node->var.name], "");
+            if (ssa_mode) return ssa_read(ssa_var(node->var.slot), LLVMGetInsertBlock(builder));
+            return LLVMBuildLoad2(builder, LLVMInt32Type(), slot_refs[node->var.slot], "");
         case ast_uexpr: {
-            LLVMValueRef v = genIRExpr(node->uexpr.expr);
+            LLVMValueRef v = pop_value();
             return LLVMBuildSub(builder, LLVMConstInt(LLVMInt32Type(), 0, 0), v, "");
         }
         case ast_bexpr: {
-            LLVMValueRef l = genIRExpr(node->bexpr.lhs);
-            LLVMValueRef r = genIRExpr(node->bexpr.rhs);
+            LLVMValueRef r = pop_value();
+            LLVMValueRef l = pop_value();
             if (node->bexpr.op == add) return LLVMBuildAdd(builder, l, r, "");
             if (node->bexpr.op == sub) return LLVMBuildSub(builder, l, r, "");
             if (node->bexpr.op == mul) return LLVMBuildMul(builder, l, r, "");
             return NULL;
         }
         case ast_rexpr: {
-            LLVMValueRef l = genIRExpr(node->rexpr.lhs);
-            LLVMValueRef r = genIRExpr(node->rexpr.rhs);
+            LLVMValueRef r = pop_value();
+            LLVMValueRef l = pop_value();
             LLVMIntPredicate p;
             if (node->rexpr.op == lt) p = LLVMIntSLT;
             else if (node->rexpr.op == gt) p = LLVMIntSGT;
@@ -358,14 +650,181 @@ LLVMValueRef genIRExpr(astNode *node) {
             return LLVMBuildICmp(builder, p, l, r, "");
         }
         case ast_stmt: {
-            if (node->stmt.type == ast_call) {
-                LLVMTypeRef read_type = LLVMFunctionType(LLVMInt32Type(), NULL, 0 , 0);
-                return LLVMBuildCall2(builder, read_type, func_read, NULL, 0, "");
-            }
-            return NULL;
+            // a call of read, print or a function defined before, with
+            // its argument if it has one on top of value_stack
+            astCall *call = &(node->stmt.call);
+            LLVMValueRef callee = LLVMGetNamedFunction(module, call->name);
+            LLVMValueRef arg = call->param != NULL ? pop_value() : NULL;
+            return LLVMBuildCall2(builder, LLVMGlobalGetValueType(callee), callee, &arg, arg != NULL ? 1 : 0, "");
        }
         default: return NULL;
     }
 
+}
+
+LLVMValueRef genIRExpr(astNode *node) {
+
+    if (!node) return NULL;
+    // post order: a node is pushed back once more below its operands and
+    // built when it comes off the stack the second time
+    expr_stack.clear();
+    value_stack.clear();
+    LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
+    if (bb != shared_block) {
+        shared_values.clear();
+        shared_block = bb;
+    }
+    expr_frame root = {node, false};
+    expr_stack.push_back(root);
+    while (!expr_stack.empty()) {
+        expr_frame f = expr_stack.back();
+        expr_stack.pop_back();
+        if (f.node->shared && f.node->type != ast_cnst) {
+            unordered_map<astNode*, LLVMValueRef>::iterator it = shared_values.find(f.node);
+            if (it != shared_values.end()) {
+                value_stack.push_back(it->second);
+                continue;
+            }
+        }
+        if (!f.operands_done) {
+            expr_frame self = {f.node, true};
+            if (f.node->type == ast_bexpr || f.node->type == ast_rexpr) {
+                astNode *lhs = f.node->type == ast_bexpr ? f.node->bexpr.lhs : f.node->rexpr.lhs;
+                astNode *rhs = f.node->type == ast_bexpr ? f.node->bexpr.rhs : f.node->rexpr.rhs;
+                expr_frame l = {lhs, false}, r = {rhs, false};
+                expr_stack.push_back(self);
+                expr_stack.push_back(r);
+                expr_stack.push_back(l);
+                continue;
+            }
+            if (f.node->type == ast_uexpr) {
+                expr_frame e = {f.node->uexpr.expr, false};
+                expr_stack.push_back(self);
+                expr_stack.push_back(e);
+                continue;
+            }
+            if (f.node->type == ast_stmt && f.node->stmt.call.param != NULL) {
+                expr_frame e = {f.node->stmt.call.param, false};
+                expr_stack.push_back(self);
+                expr_stack.push_back(e);
+                continue;
+            }
+        }
+        LLVMValueRef v = genIRNode(f.node);
+        if (f.node->shared && f.node->type != ast_cnst) shared_values[f.node] = v;
+        value_stack.push_back(v);
+    }
+    return pop_value();
+}
+
+/*
+ * Streaming mode: the parser hands over each statement as soon as it is
+ * reduced (see stream.c) and the IR is built right away, in the same
+ * order genIRStmt builds it. An if or while stays open on open_stmts
+ * while its body is parsed, holding what its frame would hold.
+ */
+static LLVMBasicBlockRef stream_entryBB;
+static LLVMBasicBlockRef stream_curBB; // block the statements so far ended in
+static vector<stmt_frame> open_stmts;
+
+void build_module_begin() {
+    begin_module();
+}
+
+LLVMModuleRef build_module_end() {
+    return finish_module();
+}
+
+void build_func_begin(const char *name, astNode *param) {
+    stream_entryBB = begin_function(name, param != NULL);
+    stream_curBB = stream_entryBB;
+    open_stmts.clear();
+    if (param != NULL) {
+        add_local(param, stream_entryBB);
+        store_param(param, stream_entryBB);
+    }
+}
+
+void build_local(astNode *decl) {
+    add_local(decl, stream_curBB);
+}
+
+void build_stmt(astNode *node) {
+    stream_curBB = genIRStmt(node, stream_curBB);
+}
+
+/*
+ * An if or while after a return is never reached; it gets a frame with
+ * no blocks so its end finds nothing to join and the current block stays
+ * NULL.
+ */
+void build_if_begin(astNode *cond) {
+    if (stream_curBB == NULL) {
+        stmt_frame dead = {NULL, 0, 0, NULL, NULL, NULL};
+        open_stmts.push_back(dead);
+        return;
+    }
+    LLVMValueRef func = LLVMGetBasicBlockParent(stream_curBB);
+    LLVMPositionBuilderAtEnd(builder, stream_curBB);
+    LLVMValueRef condVal = genIRExpr(cond);
+    LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
+    LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
+    LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
+    if (ssa_mode) ssa_unsealed(falseBB);
+    stmt_frame f = {NULL, 0, 0, NULL, falseBB, NULL};
+    open_stmts.push_back(f);
+    stream_curBB = trueBB;
+}
+
+void build_if_else() {
+    // the if body ended in stream_curBB, now the else body
+    stmt_frame &f = open_stmts.back();
+    f.state = 2;
+    if (f.falseBB == NULL) return;
+    if (ssa_mode) ssa_seal(f.falseBB);
+    f.ifExitBB = stream_curBB;
+    stream_curBB = f.falseBB;
+}
+
+void build_if_end() {
+    stmt_frame f = open_stmts.back();
+    open_stmts.pop_back();
+    if (f.falseBB == NULL) return;
+    if (f.state == 2) stream_curBB = end_if_else(f.ifExitBB, stream_curBB);
+    else stream_curBB = end_if(stream_curBB, f.falseBB);
+}
+
+void build_while_begin(astNode *cond) {
+    if (stream_curBB == NULL) {
+        stmt_frame dead = {NULL, 0, 0, NULL, NULL, NULL};
+        open_stmts.push_back(dead);
+        return;
+    }
+    LLVMValueRef func = LLVMGetBasicBlockParent(stream_curBB);
+    LLVMPositionBuilderAtEnd(builder, stream_curBB);
+    LLVMBasicBlockRef condBB = LLVMAppendBasicBlock(func, "condBB");
+    LLVMBuildBr(builder, condBB);
+    if (ssa_mode) ssa_unsealed(condBB);
+
+    LLVMPositionBuilderAtEnd(builder, condBB);
+    LLVMValueRef condVal = genIRExpr(cond);
+    LLVMBasicBlockRef trueBB = LLVMAppendBasicBlock(func, "trueBB");
+    LLVMBasicBlockRef falseBB = LLVMAppendBasicBlock(func, "falseBB");
+    LLVMBuildCondBr(builder, condVal, trueBB, falseBB);
+
+    stmt_frame f = {NULL, 0, 0, condBB, falseBB, NULL};
+    open_stmts.push_back(f);
+    stream_curBB = trueBB;
+}
+
+void build_while_end() {
+    stmt_frame f = open_stmts.back();
+    open_stmts.pop_back();
+    if (f.condBB == NULL) return;
+    stream_curBB = end_while(stream_curBB, f.condBB, f.falseBB);
+}
 
+void build_func_end() {
+    assert(open_stmts.empty());
+    end_function(stream_curBB);
 }
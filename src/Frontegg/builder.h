@@ -11,11 +11,40 @@
 #include <llvm-c/Types.h>
 
 
-void process(astNode *node, size_t level);
-void processStmt(astStmt *stmt, size_t level);
-char* to_ast_str(string s);
-string gen_unique_name(string var_name, size_t level);
-void rename_ast(astNode *root, const char* output_file);
+/*
+ * With ssa_mode set the builder keeps scalar locals in registers: values
+ * are built in SSA form with phis at the joins instead of an alloca per
+ * local with loads and stores (see builder.c).
+ */
+extern bool ssa_mode;
+
+// builds the module of the program, the caller owns it
+LLVMModuleRef rename_ast(astNode *root);
 void build(astNode *node);
 LLVMBasicBlockRef genIRStmt(astNode *node, LLVMBasicBlockRef startBB);
 LLVMValueRef genIRExpr(astNode *node);
+
+/*
+ * Streaming mode, driven by stream.c: the module is built one statement
+ * at a time while parsing. An if or while is opened with its condition
+ * before its body is parsed and closed after it.
+ */
+void build_module_begin();
+LLVMModuleRef build_module_end();
+void build_func_begin(const char *name, astNode *param);
+void build_local(astNode *decl);
+void build_stmt(astNode *node);
+void build_if_begin(astNode *cond);
+void build_if_else();
+void build_if_end();
+void build_while_begin(astNode *cond);
+void build_while_end();
+void build_func_end();
+
+/* size of the module the builder finished last, for -stats */
+typedef struct {
+    size_t blocks;
+    size_t instructions;
+} irStats;
+
+irStats builderCounts();
@@ -4,22 +4,34 @@
 #include <stdarg.h>
 #include "../ast/ast.h"
 #include "semantic.h"
+#include "stream.h"
 #define YYDEBUG 1
+/* the parser stacks live on the heap and grow on demand; allow nesting
+   far deeper than the default of 10000 */
+#define YYMAXDEPTH 10000000
 extern int yylex(astNode **root);
 extern FILE *yyin;
 int yyerror(astNode **root, const char *);
+
+/* in streaming mode a statement is lowered as soon as it is reduced and
+   no tree is kept, see stream.c */
+static astNode* statement_done(astNode *node) {
+    if (!stream_mode) return node;
+    stream_stmt(node);
+    return NULL;
+}
 %}
 %union {
     int iValue;
-    char *sIndex;
+    symId sym;
     astNode *nPtr;
-    vector<astNode*> *stmtList;
+    astList *stmtList;
 };
 %parse-param { astNode **root }
 %lex-param { astNode **root }
-%token <sIndex> VARIABLE FNAME READ PRINT
+%token <sym> VARIABLE FNAME READ PRINT
 %token <iValue> NUMBER
-%type <nPtr> expression statement functiondef block decl extern program
+%type <nPtr> expression statement functiondef functions block decl extern program if_head
 %type <stmtList> statement_list decl_list
 %token TYPE EXTERN IF ELSE WHILE RETURN VOID
 %nonassoc IFX
@@ -30,12 +42,20 @@ int yyerror(astNode **root, const char *);
 %left '*' '/'
 %nonassoc UMINUS
 %%
-program: extern extern functiondef                  {
-                                                        *root = createProg($1, $2, $3);
+program: extern extern functions                   {
+                                                        if (!stream_mode) *root = createProg($1, $2, $3);
                                                     }
-        | functiondef                               {
-                                                        *root = createProg(NULL, NULL, $1); 
+        | functions                                 {
+                                                        if (!stream_mode) *root = createProg(NULL, NULL, $1); 
                                                     }
+functions: functiondef                              {
+                                                        $$ = $1;
+                                                    }
+        | functiondef functions                     {
+                                                        if (!stream_mode) $1->func.next = $2;
+                                                        $$ = $1;
+                                                    }
+        ;
 extern: EXTERN TYPE READ '(' ')' ';'                {
                                                         $$ = createExtern($3);
                                                     }
@@ -43,72 +63,112 @@ extern: EXTERN TYPE READ '(' ')' ';'                {
                                                         $$ = createExtern($3);
                                                     }
     ;
-functiondef: TYPE VARIABLE '(' ')' block          {
-                                                        $$ = createFunc($2, NULL, $5);
+functiondef: TYPE VARIABLE '(' ')'                 {
+                                                        if (stream_mode) stream_func_begin($2, NULL);
+                                                    }
+             block                                  {
+                                                        if (stream_mode) stream_func_end();
+                                                        $$ = stream_mode ? NULL : createFunc($2, NULL, $6);
+                                                    }
+    | TYPE VARIABLE '(' TYPE VARIABLE ')'           {
+                                                        $<nPtr>$ = createDecl($5);
+                                                        if (stream_mode) stream_func_begin($2, $<nPtr>$);
                                                     }
-    | TYPE VARIABLE '(' TYPE VARIABLE ')' block        {
-                                                        $$ = createFunc($2, createDecl($5), $7);
+             block                                  {
+                                                        if (stream_mode) stream_func_end();
+                                                        $$ = stream_mode ? NULL : createFunc($2, $<nPtr>7, $8);
                                                     }
            ;
-block: '{' decl_list statement_list '}'           {
-                                                        $2->insert($2->end(), $3->begin(), $3->end());
-                                                        $$ = createBlock($2);
+block: block_open decl_list statement_list '}'    {
+                                                        if (stream_mode) {
+                                                            stream_block_close();
+                                                            $$ = NULL;
+                                                        } else {
+                                                            $2->insert($2->end(), $3->begin(), $3->end());
+                                                            $$ = createBlock($2);
+                                                        }
+                                                    }
+     | block_open decl_list '}'                     {
+                                                        if (stream_mode) stream_block_close();
+                                                        $$ = stream_mode ? NULL : createBlock($2);
                                                     }
-     | '{' decl_list '}'                            {
-                                                        $$ = createBlock($2);
+     | block_open statement_list '}'                {
+                                                        if (stream_mode) stream_block_close();
+                                                        $$ = stream_mode ? NULL : createBlock($2);
                                                     }
-     | '{' statement_list '}'                       {
-                                                        $$ = createBlock($2);
+     | block_open '}'                               {
+                                                        if (stream_mode) stream_block_close();
+                                                        $$ = stream_mode ? NULL : createBlock(createList());
                                                     }
-     | '{' '}'                                      {
-                                                        $$ = createBlock(new vector<astNode*>());
+     ;
+block_open: '{'                                     {
+                                                        if (stream_mode) stream_block_open();
                                                     }
      ;
 decl_list: decl                                     {
-                                                        $$ = new vector<astNode*>();
-                                                        $$->push_back($1);
+                                                        $$ = stream_mode ? NULL : createList();
+                                                        if (!stream_mode) $$->push_back($1);
                                                         }
         | decl_list decl                            {
-                                                        $1->push_back($2);
+                                                        if (!stream_mode) $1->push_back($2);
                                                         $$ = $1;
                                                     }
         ;
 decl: TYPE VARIABLE ';'                              {
                                                         $$ = createDecl($2);
+                                                        if (stream_mode) {
+                                                            stream_decl($$);
+                                                            $$ = NULL;
+                                                        }
                                                     }
     ;
 
 statement: VARIABLE '=' expression ';'              {    
-                                                        $$ = createAsgn(createVar($1), $3);
+                                                        $$ = statement_done(createAsgn(createVar($1), $3));
                                                     }
-          | PRINT '('expression')'';'  { $$ = createCall($1, $3); }
+          | PRINT '('expression')'';'  { $$ = statement_done(createCall($1, $3)); }
 
          | expression ';'                           {   
-                                                        $$ = $1; 
+                                                        $$ = statement_done($1); 
                                                     }
         | block                                     {
                                                         $$ = $1;
                                                     }
-        | IF '(' expression ')' statement %prec IFX     {
-                                                                $$ = createIf($3, $5, NULL);
+        | if_head statement %prec IFX               {
+                                                        if (stream_mode) stream_if_end();
+                                                        $$ = stream_mode ? NULL : createIf($1, $2, NULL);
                                                     }
-        | IF '(' expression ')' statement ELSE statement    {
-                                                        $$ = createIf($3, $5, $7);
+        | if_head statement ELSE                    {
+                                                        if (stream_mode) stream_if_else();
                                                     }
-        | WHILE '(' expression ')' block            {
-                                                        $$ = createWhile($3, $5);
+             statement                              {
+                                                        if (stream_mode) stream_if_end();
+                                                        $$ = stream_mode ? NULL : createIf($1, $2, $5);
+                                                    }
+        | WHILE '(' expression ')'                  {
+                                                        if (stream_mode) stream_while_begin($3);
+                                                    }
+             block                                  {
+                                                        if (stream_mode) stream_while_end();
+                                                        $$ = stream_mode ? NULL : createWhile($3, $6);
                                                     }
         | RETURN expression ';'                     {
-                                                        $$ = createRet($2);
+                                                        $$ = statement_done(createRet($2));
                                                     }
          ;
 
+if_head: IF '(' expression ')'                      {
+                                                        if (stream_mode) stream_if_begin($3);
+                                                        $$ = stream_mode ? NULL : $3;
+                                                    }
+       ;
+
 statement_list: statement                           {   
-                                                        $$ = new vector<astNode*> (); 
-                                                        $$->push_back($1); 
+                                                        $$ = stream_mode ? NULL : createList(); 
+                                                        if (!stream_mode) $$->push_back($1); 
                                                     }
             | statement_list statement                 {
-                                                        $1->push_back($2);
+                                                        if (!stream_mode) $1->push_back($2);
                                                         $$ = $1;
                                                     }
             ;
@@ -127,6 +187,8 @@ expression: expression '+' expression   { $$ = createBExpr($1, $3, add); }
           | '-' expression %prec UMINUS     { $$ = createUExpr($2, uminus); }
           | NUMBER              {$$ = createCnst($1);}
           | READ '(' ')'            { $$ = createCall($1, NULL); }
+          | VARIABLE '(' expression ')' { $$ = createCall($1, $3); }
+          | VARIABLE '(' ')'        { $$ = createCall($1, NULL); }
           | VARIABLE                    { $$ = createVar($1); }
           ;
         
@@ -0,0 +1,92 @@
+/*
+Lexer throughput. Writes a large generated miniC file and scans it with
+whichever yylex the program is linked against; `make lexbench` builds
+and runs it once against the flex scanner and once against lexer.c.
+	./lexbench_hand [megabytes] [repeats]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../ast/ast.h"
+#include "y.tab.h"
+
+extern int yylex(astNode **root);
+extern int lexer_open(const char *path);
+extern void lexer_close(void);
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* machine generated looking code: long identifiers, deep indentation,
+every token kind the scanner knows */
+static size_t generate(FILE *f, size_t bytes){
+	static const char *ops[] = {" + ", " - ", " * ", " < ", " >= ", " == ", " != "};
+	size_t written = 0;
+	unsigned seed = 1;
+	written += fprintf(f, "extern void print(int);\nextern int read();\n\nint func(int p){\n");
+	for (int i = 0; i < 64; i++)
+		written += fprintf(f, "\tint tmpValue%d;\n", i);
+	while (written < bytes){
+		seed = seed * 1103515245u + 12345u;
+		int a = (seed >> 8) % 64, b = (seed >> 14) % 64, depth = 1 + (seed >> 20) % 6;
+		written += fprintf(f, "%*s", depth * 4, "");
+		switch ((seed >> 24) % 4){
+			case 0:
+				written += fprintf(f, "tmpValue%d = tmpValue%d%s%u;\n", a, b, ops[(seed >> 3) % 7], seed % 100000);
+				break;
+			case 1:
+				written += fprintf(f, "while (tmpValue%d < p) {\n%*stmpValue%d = read();\n%*s}\n", a, depth * 4 + 4, "", b, depth * 4, "");
+				break;
+			case 2:
+				written += fprintf(f, "if (tmpValue%d <= %u) { print(tmpValue%d); } else { tmpValue%d = -tmpValue%d; }\n", a, seed % 1000, b, a, b);
+				break;
+			default:
+				written += fprintf(f, "tmpValue%d = (tmpValue%d / 3) * (tmpValue%d - 12);\n", a, b, a);
+				break;
+		}
+	}
+	written += fprintf(f, "\treturn tmpValue0;\n}\n");
+	return written;
+}
+
+int main(int argc, char **argv){
+	double megabytes = argc > 1 ? atof(argv[1]) : 64;
+	int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+	char path[] = "/tmp/lexbenchXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0){
+		perror("mkstemp");
+		return 1;
+	}
+	FILE *f = fdopen(fd, "w");
+	size_t bytes = generate(f, (size_t) (megabytes * 1024 * 1024));
+	fclose(f);
+
+	long tokens = 0;
+	double best = 0;
+	for (int r = 0; r < repeats; r++){
+		if (lexer_open(path) != 0){
+			fprintf(stderr, "cannot open %s\n", path);
+			unlink(path);
+			return 1;
+		}
+		tokens = 0;
+		double t0 = now();
+		while (yylex(NULL) != 0)
+			tokens++;
+		double t = now() - t0;
+		lexer_close();
+		if (r == 0 || t < best)
+			best = t;
+	}
+	unlink(path);
+
+	printf("%.1f MB, %ld tokens: %.2f ms, %.1f MB/s\n", bytes / 1e6, tokens, best * 1e3, bytes / 1e6 / best);
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Hand written scanner, a drop-in replacement for the flex scanner of
+ * frontend.l (build with `make LEXER=hand`). It accepts exactly the same
+ * tokens, behind the same yylex/lexer_open/lexer_close interface.
+ *
+ * The source is mapped into memory and scanned in place. Whitespace,
+ * digit and identifier runs are skipped a vector at a time: a vector
+ * compare gives a bit mask of the bytes that belong to the run and the
+ * first zero bit is where the run ends. Keywords are found with a
+ * perfect hash over the identifier's length and its first and last
+ * character, followed by one compare.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../ast/ast.h"
+#include "y.tab.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int yyerror(astNode **root, const char *s);
+
+// the mapping has at least this many zero bytes past the end of the
+// text, so a vector load that starts inside the text never faults
+#define LEX_PAD 64
+
+static char *src_map = NULL;
+static size_t src_map_len = 0;
+static char *src_heap = NULL;      // text read from stdin when no file was opened
+static const char *src_cur = NULL; // next character to scan
+static const char *src_end = NULL; // one past the last character of the text
+
+static inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+static inline bool isAlnum(char c) { return isDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z'); }
+
+/*
+ * Per-vector class masks: bit i is set when byte p[i] is in the class.
+ * VEC_BYTES bytes are looked at, the rest of the mask is zero.
+ */
+#if defined(__AVX2__)
+
+#define VEC_BYTES 32
+typedef __m256i vec;
+
+static inline vec vload(const char *p) { return _mm256_loadu_si256((const __m256i *) p); }
+static inline vec vsplat(char c) { return _mm256_set1_epi8(c); }
+static inline vec veq(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vec vgt(vec a, vec b) { return _mm256_cmpgt_epi8(a, b); }
+static inline vec vor(vec a, vec b) { return _mm256_or_si256(a, b); }
+static inline vec vadd(vec a, vec b) { return _mm256_add_epi8(a, b); }
+static inline uint32_t vmask(vec a) { return (uint32_t) _mm256_movemask_epi8(a); }
+
+#elif defined(__SSE2__)
+
+#define VEC_BYTES 16
+typedef __m128i vec;
+
+static inline vec vload(const char *p) { return _mm_loadu_si128((const __m128i *) p); }
+static inline vec vsplat(char c) { return _mm_set1_epi8(c); }
+static inline vec veq(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec vgt(vec a, vec b) { return _mm_cmpgt_epi8(a, b); }
+static inline vec vor(vec a, vec b) { return _mm_or_si128(a, b); }
+static inline vec vadd(vec a, vec b) { return _mm_add_epi8(a, b); }
+static inline uint32_t vmask(vec a) { return (uint32_t) _mm_movemask_epi8(a); }
+
+#endif
+
+#ifdef VEC_BYTES
+
+#define ALL_BYTES ((uint32_t) (((uint64_t) 1 << VEC_BYTES) - 1))
+
+// lo <= c <= hi, done as one signed compare after shifting lo to -128
+static inline vec vrange(vec c, char lo, char hi) {
+    vec shifted = vadd(c, vsplat((char) (-128 - lo)));
+    return vgt(vsplat((char) (-128 + (hi - lo) + 1)), shifted);
+}
+
+static inline uint32_t spaceMask(const char *p) {
+    vec c = vload(p);
+    return vmask(vor(vor(veq(c, vsplat(' ')), veq(c, vsplat('\t'))), veq(c, vsplat('\n'))));
+}
+
+static inline uint32_t digitMask(const char *p) {
+    return vmask(vrange(vload(p), '0', '9'));
+}
+
+static inline uint32_t alnumMask(const char *p) {
+    vec c = vload(p);
+    // setting bit 5 folds upper case onto lower case and keeps digits as they are
+    vec lower = vor(c, vsplat(0x20));
+    return vmask(vor(vrange(lower, 'a', 'z'), vrange(c, '0', '9')));
+}
+
+/*
+ * Skips the run of bytes in the class starting at p. Most runs between
+ * tokens are a single blank, so the first two bytes are tested one at a
+ * time and only longer runs go a vector at a time.
+ */
+#define SKIP_RUN(p, isfn, maskfn)                                   \
+    if (isfn(*p) && isfn(*++p)) {                                   \
+        for (;;) {                                                  \
+            uint32_t m = ~maskfn(p) & ALL_BYTES;                    \
+            if (m != 0) { p += __builtin_ctz(m); break; }           \
+            p += VEC_BYTES;                                         \
+        }                                                           \
+    }
+
+#else
+
+#define SKIP_RUN(p, isfn, maskfn) while (isfn(*p)) p++;
+
+#endif
+
+/*
+ * Keywords, placed at (first + 7*last + length) % 16. The hash is
+ * collision free over the keywords, so one compare decides.
+ */
+typedef struct {
+    const char *word;
+    int len;
+    int token;
+} keyword;
+
+static const keyword keywords[16] = {
+    /* 0 */ {NULL, 0, 0},
+    /* 1 */ {"print", 5, PRINT},
+    /* 2 */ {"read", 4, READ},
+    /* 3 */ {NULL, 0, 0},
+    /* 4 */ {NULL, 0, 0},
+    /* 5 */ {"if", 2, IF},
+    /* 6 */ {"void", 4, VOID},
+    /* 7 */ {NULL, 0, 0},
+    /* 8 */ {"int", 3, TYPE},
+    /* 9 */ {NULL, 0, 0},
+    /* 10 */ {"return", 6, RETURN},
+    /* 11 */ {NULL, 0, 0},
+    /* 12 */ {"else", 4, ELSE},
+    /* 13 */ {"extern", 6, EXTERN},
+    /* 14 */ {NULL, 0, 0},
+    /* 15 */ {"while", 5, WHILE},
+};
+
+static inline int keywordToken(const char *s, size_t len) {
+    if (len < 2 || len > 6) return 0;
+    const keyword &k = keywords[((unsigned char) s[0] + 7 * (unsigned char) s[len - 1] + len) & 15];
+    if (k.len == (int) len && memcmp(k.word, s, len) == 0) return k.token;
+    return 0;
+}
+
+/* Without lexer_open the scanner reads stdin, like flex does. */
+static void readStdin() {
+    size_t size = 0, cap = 64 * 1024;
+    src_heap = (char *) malloc(cap + LEX_PAD);
+    size_t n;
+    while ((n = fread(src_heap + size, 1, cap - size, stdin)) > 0) {
+        size += n;
+        if (size == cap) {
+            cap *= 2;
+            src_heap = (char *) realloc(src_heap, cap + LEX_PAD);
+        }
+    }
+    memset(src_heap + size, 0, LEX_PAD);
+    src_cur = src_heap;
+    src_end = src_heap + size;
+}
+
+int yylex(astNode **root) {
+    if (src_cur == NULL) readStdin();
+    const char *p = src_cur;
+    SKIP_RUN(p, isSpace, spaceMask);
+    if (p >= src_end) {
+        src_cur = src_end;
+        return 0;
+    }
+
+    const char *start = p;
+    char c = *p;
+
+    if (isDigit(c)) {
+        SKIP_RUN(p, isDigit, digitMask);
+        // out of range values wrap around
+        unsigned value = 0;
+        for (const char *d = start; d < p; d++) value = value * 10 + (*d - '0');
+        src_cur = p;
+        yylval.iValue = (int) value;
+        return NUMBER;
+    }
+
+    if (isAlnum(c)) {
+        SKIP_RUN(p, isAlnum, alnumMask);
+        src_cur = p;
+        size_t len = p - start;
+        int token = keywordToken(start, len);
+        if (token == READ || token == PRINT || token == 0) {
+            yylval.sym = internName(start, len);
+            return token == 0 ? VARIABLE : token;
+        }
+        return token;
+    }
+
+    src_cur = p + 1;
+    switch (c) {
+        case '>': if (p[1] == '=') { src_cur++; return GE; } return c;
+        case '<': if (p[1] == '=') { src_cur++; return LE; } return c;
+        case '=': if (p[1] == '=') { src_cur++; return EQ; } return c;
+        case '!': if (p[1] == '=') { src_cur++; return NE; } break;
+        case '-': case '(': case ')': case '+': case '*': case '/':
+        case ';': case '{': case '}': case '.':
+            return c;
+        default: break;
+    }
+    return yyerror(root, "Unknown character");
+}
+
+/* Map the source file into memory. The mapping is backed by a zeroed
+ * anonymous region at least LEX_PAD bytes longer than the file, which
+ * ends every run the scanner skips and keeps vector loads in bounds. */
+int lexer_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+    src_map_len = ((size + LEX_PAD + page - 1) / page) * page;
+
+    src_map = (char *) mmap(NULL, src_map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (src_map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (size > 0 && mmap(src_map, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(src_map, src_map_len);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    src_cur = src_map;
+    src_end = src_map + size;
+    return 0;
+}
+
+void lexer_close(void) {
+    if (src_map != NULL) munmap(src_map, src_map_len);
+    free(src_heap);
+    src_map = NULL;
+    src_heap = NULL;
+    src_cur = src_end = NULL;
+}
@@ -0,0 +1,145 @@
+/*
+Parse time of the yacc parser against the recursive descent one on a
+large generated miniC file. Each run parses into a fresh arena; the
+time of only scanning the file is shown too, as both parsers pay for it.
+Build with `make parsebench` and run
+	./parsebench [megabytes] [repeats]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../ast/ast.h"
+#include "parser.h"
+#include "y.tab.h"
+
+extern int yylex(astNode **root);
+extern int yyparse(astNode **root);
+extern int lexer_open(const char *path);
+extern void lexer_close(void);
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned seed = 1;
+
+static unsigned rnd(unsigned n){
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+static size_t genExpr(FILE *f, int depth){
+	static const char *ops[] = {" + ", " - ", " * ", " / ", " < ", " >= ", " == ", " != "};
+	switch (depth <= 0 ? rnd(2) : rnd(5)){
+		case 0: return fprintf(f, "x%u", rnd(32));
+		case 1: return fprintf(f, "%u", rnd(1000));
+		case 2: return fprintf(f, "(") + genExpr(f, depth - 1) + fprintf(f, ")");
+		case 3: return fprintf(f, "-") + genExpr(f, depth - 1);
+		default: {
+			size_t n = genExpr(f, depth - 1);
+			n += fprintf(f, "%s", ops[rnd(8)]);
+			return n + genExpr(f, depth - 1);
+		}
+	}
+}
+
+/* statements nested a few levels deep, with expressions of a few dozen terms */
+static size_t genStmts(FILE *f, int depth, size_t bytes){
+	size_t written = 0;
+	while (written < bytes){
+		switch (depth <= 0 ? 0 : rnd(4)){
+			case 1:
+				written += fprintf(f, "while (") + genExpr(f, 2) + fprintf(f, ") {\n");
+				written += genStmts(f, depth - 1, bytes / 4);
+				written += fprintf(f, "}\n");
+				break;
+			case 2:
+				written += fprintf(f, "if (") + genExpr(f, 2) + fprintf(f, ") {\n");
+				written += genStmts(f, depth - 1, bytes / 8);
+				written += fprintf(f, "} else {\n");
+				written += genStmts(f, depth - 1, bytes / 8);
+				written += fprintf(f, "}\n");
+				break;
+			default:
+				written += fprintf(f, "x%u = ", rnd(32)) + genExpr(f, 5) + fprintf(f, ";\n");
+				break;
+		}
+	}
+	return written;
+}
+
+static size_t generate(FILE *f, size_t bytes){
+	size_t written = fprintf(f, "extern void print(int);\nextern int read();\n\nint func(int p){\n");
+	for (int i = 0; i < 32; i++)
+		written += fprintf(f, "int x%d;\n", i);
+	// top level chunks keep the nesting bounded whatever the size
+	while (written < bytes)
+		written += genStmts(f, 4, 64 * 1024);
+	return written + fprintf(f, "return x0;\n}\n");
+}
+
+/* best time of repeats runs of parse over path; parse NULL only scans */
+static double timeRuns(const char *path, int (*parse)(astNode **), int repeats){
+	double best = 0;
+	for (int r = 0; r < repeats; r++){
+		if (lexer_open(path) != 0){
+			fprintf(stderr, "cannot open %s\n", path);
+			exit(1);
+		}
+		astArena arena;
+		arenaInit(&arena);
+		setAstArena(&arena);
+		astNode *root = NULL;
+
+		double t0 = now();
+		int failed = 0;
+		if (parse == NULL){
+			while (yylex(&root) != 0)
+				;
+		} else {
+			failed = parse(&root);
+		}
+		double t = now() - t0;
+
+		setAstArena(NULL);
+		arenaRelease(&arena);
+		lexer_close();
+		if (failed){
+			fprintf(stderr, "parse error in the generated file\n");
+			exit(1);
+		}
+		if (r == 0 || t < best)
+			best = t;
+	}
+	return best;
+}
+
+int main(int argc, char **argv){
+	double megabytes = argc > 1 ? atof(argv[1]) : 32;
+	int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+	char path[] = "/tmp/parsebenchXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0){
+		perror("mkstemp");
+		return 1;
+	}
+	FILE *f = fdopen(fd, "w");
+	size_t bytes = generate(f, (size_t) (megabytes * 1024 * 1024));
+	fclose(f);
+
+	double scan = timeRuns(path, NULL, repeats);
+	double yacc = timeRuns(path, yyparse, repeats);
+	double rd = timeRuns(path, rdparse, repeats);
+	unlink(path);
+
+	printf("%.1f MB of source\n", bytes / 1e6);
+	printf("%-8s %10s %10s\n", "", "ms", "MB/s");
+	printf("%-8s %10.2f %10.1f\n", "scan", scan * 1e3, bytes / 1e6 / scan);
+	printf("%-8s %10.2f %10.1f\n", "yacc", yacc * 1e3, bytes / 1e6 / yacc);
+	printf("%-8s %10.2f %10.1f\n", "rd", rd * 1e3, bytes / 1e6 / rd);
+	return 0;
+}
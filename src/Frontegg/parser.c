@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../ast/ast.h"
+#include "parser.h"
+#include "y.tab.h"
+
+/*
+ * Recursive descent parser for the grammar of frontend.y, with Pratt
+ * style precedence climbing for expressions. It takes its tokens from
+ * the same yylex and builds the same AST as the yacc parser, but each
+ * block collects its declarations and statements straight into the one
+ * list the block keeps, instead of building decl_list and
+ * statement_list and splicing them together.
+ *
+ * Nothing recurses per nesting level: expressions are parsed over an
+ * operator and an operand stack, and statements keep a frame for each
+ * open block, if and while, so deeply nested input needs no more native
+ * stack than flat input, as with the walkers of the later passes.
+ */
+
+extern int yylex(astNode **root);
+int yyerror(astNode **root, const char *s);
+
+typedef struct {
+    int kind;      // token number, 0 at the end of the input
+    YYSTYPE value;
+} token;
+
+static token tok;           // current token
+static token ahead;         // the one after it, valid when has_ahead
+static bool has_ahead = false;
+static astNode **lex_root;  // passed through to yylex and yyerror
+static bool failed = false;
+
+static token read_token() {
+    token t;
+    t.kind = yylex(lex_root);
+    t.value = yylval;
+    return t;
+}
+
+static void next() {
+    if (has_ahead) {
+        tok = ahead;
+        has_ahead = false;
+    } else {
+        tok = read_token();
+    }
+}
+
+static int peek() {
+    if (!has_ahead) {
+        ahead = read_token();
+        has_ahead = true;
+    }
+    return ahead.kind;
+}
+
+// reports the first error only, like yyparse which stops at the first one
+static void syntax_error() {
+    if (!failed) yyerror(lex_root, "syntax error");
+    failed = true;
+}
+
+static bool accept(int kind) {
+    if (tok.kind != kind) return false;
+    next();
+    return true;
+}
+
+static bool expect(int kind) {
+    if (accept(kind)) return true;
+    syntax_error();
+    return false;
+}
+
+/*
+ * Binding power of binary operators, following the %left lines of
+ * frontend.y; 0 for tokens that are not binary operators.
+ */
+#define PREC_UMINUS 4
+
+static int binary_prec(int kind) {
+    switch (kind) {
+        case GE: case LE: case EQ: case NE: case '>': case '<':
+            return 1;
+        case '+': case '-':
+            return 2;
+        case '*': case '/':
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+static astNode* make_binary(int kind, astNode *lhs, astNode *rhs) {
+    switch (kind) {
+        case '+': return createBExpr(lhs, rhs, add);
+        case '-': return createBExpr(lhs, rhs, sub);
+        case '*': return createBExpr(lhs, rhs, mul);
+        case '/': return createBExpr(lhs, rhs, divide);
+        case '<': return createRExpr(lhs, rhs, lt);
+        case '>': return createRExpr(lhs, rhs, gt);
+        case GE:  return createRExpr(lhs, rhs, ge);
+        case LE:  return createRExpr(lhs, rhs, le);
+        case NE:  return createRExpr(lhs, rhs, neq);
+        default:  return createRExpr(lhs, rhs, eq);
+    }
+}
+
+/*
+ * What waits on the operator stack for its operands: a binary operator
+ * or a unary minus, or an open parenthesis or call argument list that
+ * its ')' closes.
+ */
+typedef enum {
+    op_binary,
+    op_uminus,
+    op_paren,
+    op_call
+} op_kind;
+
+typedef struct {
+    op_kind kind;
+    int token;     // the operator of op_binary
+    int prec;      // binding power, 0 for the ones closed by ')'
+    symId callee;  // the function of op_call
+} pending_op;
+
+static std::vector<pending_op> ops;
+static std::vector<astNode*> operands;
+
+static void push_op(op_kind kind, int token, int prec, symId callee) {
+    pending_op op = {kind, token, prec, callee};
+    ops.push_back(op);
+}
+
+// applies the operators on top that bind at least as tight as min_prec
+static void reduce(int min_prec) {
+    while (!ops.empty() && ops.back().prec != 0 && ops.back().prec >= min_prec) {
+        pending_op op = ops.back();
+        ops.pop_back();
+        astNode *rhs = operands.back();
+        operands.pop_back();
+        if (op.kind == op_uminus) {
+            operands.push_back(createUExpr(rhs, uminus));
+        } else {
+            operands.back() = make_binary(op.token, operands.back(), rhs);
+        }
+    }
+}
+
+/*
+ * Precedence climbing unrolled: all operators are left associative, so
+ * one on the stack is applied as soon as an operator that binds no
+ * tighter follows it. A unary minus binds tighter than any binary
+ * operator. The expression ends at the first token that can neither
+ * continue it nor close one of its parentheses; errors are found at the
+ * same tokens as the recursive version found them.
+ */
+static astNode* parse_expression() {
+    ops.clear();
+    operands.clear();
+    while (true) {
+        // an operand, after any unary minuses and open parentheses
+        switch (tok.kind) {
+            case NUMBER:
+                operands.push_back(createCnst(tok.value.iValue));
+                next();
+                break;
+            case VARIABLE: {
+                symId name = tok.value.sym;
+                if (peek() != '(') {
+                    next();
+                    operands.push_back(createVar(name));
+                    break;
+                }
+                // a call: VARIABLE '(' [expression] ')'
+                next();
+                next();
+                if (accept(')')) {
+                    operands.push_back(createCall(name, NULL));
+                    break;
+                }
+                push_op(op_call, 0, 0, name);
+                continue;
+            }
+            case READ: {
+                symId name = tok.value.sym;
+                next();
+                if (!expect('(') || !expect(')')) return NULL;
+                operands.push_back(createCall(name, NULL));
+                break;
+            }
+            case '(':
+                next();
+                push_op(op_paren, 0, 0, 0);
+                continue;
+            case '-':
+                next();
+                push_op(op_uminus, 0, PREC_UMINUS, 0);
+                continue;
+            default:
+                syntax_error();
+                return NULL;
+        }
+
+        // what follows the operand: a binary operator, or ')' closing
+        // the innermost parenthesis or call, or the end
+        while (true) {
+            int prec = binary_prec(tok.kind);
+            if (prec != 0) {
+                reduce(prec);
+                push_op(op_binary, tok.kind, prec, 0);
+                next();
+                break;
+            }
+            reduce(1);
+            if (ops.empty()) return operands.back();
+            // an open parenthesis or call is on top, only ')' closes it
+            if (!expect(')')) return NULL;
+            pending_op open = ops.back();
+            ops.pop_back();
+            if (open.kind == op_call) operands.back() = createCall(open.callee, operands.back());
+        }
+    }
+}
+
+// '(' expression ')'
+static astNode* parse_condition() {
+    if (!expect('(')) return NULL;
+    astNode *cond = parse_expression();
+    if (cond == NULL || !expect(')')) return NULL;
+    return cond;
+}
+
+// the statements that hold no other statement
+static astNode* parse_simple_statement() {
+    switch (tok.kind) {
+        case RETURN: {
+            next();
+            astNode *e = parse_expression();
+            if (e == NULL || !expect(';')) return NULL;
+            return createRet(e);
+        }
+        case PRINT: {
+            symId name = tok.value.sym;
+            next();
+            if (!expect('(')) return NULL;
+            astNode *e = parse_expression();
+            if (e == NULL || !expect(')') || !expect(';')) return NULL;
+            return createCall(name, e);
+        }
+        case VARIABLE:
+            if (peek() == '=') {
+                astNode *lhs = createVar(tok.value.sym);
+                next();
+                next();
+                astNode *rhs = parse_expression();
+                if (rhs == NULL || !expect(';')) return NULL;
+                return createAsgn(lhs, rhs);
+            }
+            // fall through, an expression statement
+        default: {
+            astNode *e = parse_expression();
+            if (e == NULL || !expect(';')) return NULL;
+            return e;
+        }
+    }
+}
+
+/*
+ * A statement that holds others waits in a frame for them: a block for
+ * each of its statements up to its '}', an if for its then and else
+ * bodies and a while for its body.
+ */
+typedef enum {
+    in_block,
+    in_then,
+    in_else,
+    in_while
+} parse_frame_kind;
+
+typedef struct {
+    parse_frame_kind kind;
+    astList *list;      // the block's declarations and statements so far
+    astNode *cond;
+    astNode *then_body;
+} parse_frame;
+
+static std::vector<parse_frame> frames;
+
+static void push_frame(parse_frame_kind kind, astList *list, astNode *cond) {
+    parse_frame f = {kind, list, cond, NULL};
+    frames.push_back(f);
+}
+
+// '{' decl*, its statements are collected in the frame it opens
+static bool open_block() {
+    if (!expect('{')) return false;
+    astList *list = createList();
+    while (tok.kind == TYPE) {
+        next();
+        if (tok.kind != VARIABLE) {
+            syntax_error();
+            return false;
+        }
+        symId name = tok.value.sym;
+        next();
+        if (!expect(';')) return false;
+        list->push_back(createDecl(name));
+    }
+    push_frame(in_block, list, NULL);
+    return true;
+}
+
+// '{' decl* statement* '}' | IF '(' expr ')' statement [ELSE statement]
+// | WHILE '(' expr ')' block | a simple statement
+static astNode* parse_statement() {
+    frames.clear();
+    while (true) {
+        // start a statement; one that holds others opens its frame and
+        // goes on with the first statement in it
+        astNode *s = NULL;
+        switch (tok.kind) {
+            case '{':
+                if (!open_block()) return NULL;
+                break;
+            case IF: {
+                next();
+                astNode *cond = parse_condition();
+                if (cond == NULL) return NULL;
+                push_frame(in_then, NULL, cond);
+                continue;
+            }
+            case WHILE: {
+                next();
+                astNode *cond = parse_condition();
+                if (cond == NULL) return NULL;
+                if (tok.kind != '{') {
+                    syntax_error();
+                    return NULL;
+                }
+                push_frame(in_while, NULL, cond);
+                if (!open_block()) return NULL;
+                break;
+            }
+            default:
+                s = parse_simple_statement();
+                if (s == NULL) return NULL;
+                break;
+        }
+
+        // hand each finished statement to the frame waiting for it,
+        // finishing the frames it completes
+        while (true) {
+            if (s == NULL) {
+                // a block was opened or took a statement, it may end here
+                if (frames.back().kind != in_block || tok.kind != '}') break;
+                next();
+                s = createBlock(frames.back().list);
+                frames.pop_back();
+            }
+            if (frames.empty()) return s;
+            parse_frame &f = frames.back();
+            if (f.kind == in_block) {
+                f.list->push_back(s);
+                s = NULL;
+            } else if (f.kind == in_then) {
+                // an else belongs to the innermost if, as %prec IFX decides in frontend.y
+                if (accept(ELSE)) {
+                    f.kind = in_else;
+                    f.then_body = s;
+                    break;
+                }
+                s = createIf(f.cond, s, NULL);
+                frames.pop_back();
+            } else if (f.kind == in_else) {
+                s = createIf(f.cond, f.then_body, s);
+                frames.pop_back();
+            } else {
+                s = createWhile(f.cond, s);
+                frames.pop_back();
+            }
+        }
+    }
+}
+
+// EXTERN TYPE READ '(' ')' ';' | EXTERN VOID PRINT '(' TYPE ')' ';'
+static astNode* parse_extern() {
+    if (!expect(EXTERN)) return NULL;
+    if (accept(TYPE)) {
+        if (tok.kind != READ) {
+            syntax_error();
+            return NULL;
+        }
+        symId name = tok.value.sym;
+        next();
+        if (!expect('(') || !expect(')') || !expect(';')) return NULL;
+        return createExtern(name);
+    }
+    if (!expect(VOID)) return NULL;
+    if (tok.kind != PRINT) {
+        syntax_error();
+        return NULL;
+    }
+    symId name = tok.value.sym;
+    next();
+    if (!expect('(') || !expect(TYPE) || !expect(')') || !expect(';')) return NULL;
+    return createExtern(name);
+}
+
+// TYPE VARIABLE '(' [TYPE VARIABLE] ')' block
+static astNode* parse_function() {
+    if (!expect(TYPE)) return NULL;
+    if (tok.kind != VARIABLE) {
+        syntax_error();
+        return NULL;
+    }
+    symId name = tok.value.sym;
+    next();
+    if (!expect('(')) return NULL;
+    astNode *param = NULL;
+    if (accept(TYPE)) {
+        if (tok.kind != VARIABLE) {
+            syntax_error();
+            return NULL;
+        }
+        param = createDecl(tok.value.sym);
+        next();
+    }
+    if (!expect(')')) return NULL;
+    if (tok.kind != '{') {
+        syntax_error();
+        return NULL;
+    }
+    astNode *body = parse_statement();
+    if (body == NULL) return NULL;
+    return createFunc(name, param, body);
+}
+
+int rdparse(astNode **root) {
+    lex_root = root;
+    failed = false;
+    has_ahead = false;
+    next();
+
+    astNode *ext1 = NULL, *ext2 = NULL;
+    if (tok.kind == EXTERN) {
+        ext1 = parse_extern();
+        if (ext1 == NULL) return 1;
+        ext2 = parse_extern();
+        if (ext2 == NULL) return 1;
+    }
+    // one or more functions, chained in source order
+    astNode *func = parse_function();
+    if (func == NULL) return 1;
+    astNode *last = func;
+    while (tok.kind != 0) {
+        last->func.next = parse_function();
+        last = last->func.next;
+        if (last == NULL) return 1;
+    }
+    *root = createProg(ext1, ext2, func);
+    return 0;
+}
@@ -0,0 +1,9 @@
+#include "../ast/ast.h"
+
+/*
+ * Hand written recursive descent parser, an alternative to the yacc
+ * parser of frontend.y (yyparse) that reads the same tokens and builds
+ * the same AST. Returns 0 and sets *root on success, 1 after reporting
+ * a syntax error.
+ */
+int rdparse(astNode **root);
@@ -2,66 +2,238 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string>
 #include "semantic.h"
 
-std::vector<vector<char *> *> symbol_stack;
+/*
+ * Scoped symbol table. Symbols are dense interned ids, so the table is a
+ * flat array indexed by id that points at the innermost binding of that
+ * symbol (a perfect hash). Bindings are kept on a stack; each binding
+ * remembers the one it shadows so popping a scope only touches the
+ * bindings made in that scope.
+ */
+typedef struct {
+    symId sym;
+    astNode *decl;  // the ast_decl node
+    size_t depth;   // scope the binding was made in
+    int prev;       // binding of the same symbol it shadows, -1 if none
+} binding;
+
+static std::vector<int> innermost;       // symId -> index into bindings, -1 if unbound
+static std::vector<binding> bindings;
+static std::vector<size_t> scope_starts; // bindings.size() when each open scope began
+
+/*
+ * Besides checking scopes, the walk gives every declaration a slot that
+ * is unique within its function and a unique name (name.level.id) for
+ * the IR, and collects the function's declarations in slot order, so the
+ * builder does not need a walk of its own.
+ */
+static astNode *cur_func = NULL;
+static size_t cur_level = 0;
+static size_t unique_id = 0;
+static int next_slot = 0;
+
+/*
+ * Functions can be called from their own definition on, by themselves
+ * and by the functions after them, as in C without prototypes. The
+ * table gives the number of parameters of each function by symId; read
+ * and print are always there.
+ */
+static std::vector<int> func_params; // symId -> parameters taken, -1 if no such function
+
+static void reset_functions() {
+    symId read = internName("read"), print = internName("print");
+    func_params.assign(numSyms(), -1);
+    func_params[read] = 0;
+    func_params[print] = 1;
+}
+
+static void declare_function(symId name, astNode *param) {
+    if ((size_t) name >= func_params.size()) func_params.resize(name + 1, -1);
+    if (func_params[name] >= 0) {
+        printf("Error: function {%s} defined twice\n", symName(name));
+        exit(-1);
+    }
+    func_params[name] = param != NULL ? 1 : 0;
+}
+
+static void check_call(astCall *call) {
+    int params = (size_t) call->sym < func_params.size() ? func_params[call->sym] : -1;
+    if (params < 0) {
+        printf("Error: function {%s} not declared\n", call->name);
+        exit(-1);
+    }
+    if (params != (call->param != NULL ? 1 : 0)) {
+        printf("Error: function {%s} takes %d argument(s)\n", call->name, params);
+        exit(-1);
+    }
+}
+
+static void name_decl(astNode *decl) {
+    astDecl *d = &(decl->stmt.decl);
+    std::string unique = std::string(d->name) + "." + std::to_string(cur_level) + "." + std::to_string(unique_id++);
+    d->sym = internName(unique.c_str());
+    d->name = symName(d->sym);
+    d->slot = next_slot++;
+    // in streaming mode there is no function node, the builder allocates
+    // the slot as soon as the declaration is seen
+    if (cur_func != NULL) cur_func->func.locals->push_back(decl);
+}
+
 int semantic_analysis(astNode *rootPtr) {
 
     //printNode(rootPtr);
     // loop throught the parse tree and create symbol table
     // declarations can only be found in functions and in statments
-    traverseRoot(rootPtr, NULL);
+    innermost.clear();
+    bindings.clear();
+    scope_starts.clear();
+    unique_id = 0;
+    reset_functions();
+    traverseRoot(rootPtr);
+
+    return 0;
+
+
+}
+
+void scope_push() {
+    scope_starts.push_back(bindings.size());
+}
+
+void scope_pop() {
+    assert(!scope_starts.empty());
+    size_t start = scope_starts.back();
+    scope_starts.pop_back();
+    while (bindings.size() > start) {
+        binding &b = bindings.back();
+        innermost[b.sym] = b.prev;
+        bindings.pop_back();
+    }
+}
 
+// returns -1 if the symbol is already declared in the current scope
+int scope_declare(astNode *decl) {
+    assert(decl->type == ast_stmt && decl->stmt.type == ast_decl);
+    symId sym = decl->stmt.decl.sym;
+    if ((size_t) sym >= innermost.size()) {
+        innermost.resize(numSyms() > (size_t) sym ? numSyms() : sym + 1, -1);
+    }
+
+    int prev = innermost[sym];
+    if (prev >= 0 && bindings[prev].depth == scope_starts.size()) {
+        return -1;
+    }
+
+    binding b = {sym, decl, scope_starts.size(), prev};
+    innermost[sym] = bindings.size();
+    bindings.push_back(b);
     return 0;
+}
 
+// returns the declaration the symbol refers to in the current scope, NULL if none
+astNode* scope_lookup(symId symbol) {
+    if (symbol < 0 || (size_t) symbol >= innermost.size() || innermost[symbol] < 0) {
+        return NULL;
+    }
+    return bindings[innermost[symbol]].decl;
+}
 
+/*
+ * The walk keeps its own stack instead of recursing, so deeply nested
+ * statements and long expression chains do not run out of native stack.
+ * Besides nodes to visit, the stack holds the actions that the recursive
+ * version ran after the children of a node: closing a scope and so on.
+ */
+typedef enum {
+    walk_visit,       // visit the node and push its children
+    walk_close_scope, // end of a block
+    walk_enter_body,  // parameter done, the function body follows
+    walk_leave_func   // end of a function
+} walk_action;
+
+typedef struct {
+    astNode *node;
+    walk_action action;
+} walk_item;
+
+static std::vector<walk_item> walk_stack;
+
+static void push_visit(astNode *node) {
+    walk_item item = {node, walk_visit};
+    walk_stack.push_back(item);
 }
 
-void traverseRoot(astNode *node, vector<char *> *symbol_table) {
+static void push_action(walk_action action) {
+    walk_item item = {NULL, action};
+    walk_stack.push_back(item);
+}
+
+static void visitStmt(astNode *node);
+
+// visits a single node; children are pushed last to first so that they
+// come off the stack in source order
+static void visit(astNode *node) {
 
     switch(node->type) {
         case ast_prog: {
-                           traverseRoot(node->prog.func, NULL);
+                           push_visit(node->prog.func);
                            break;
                        }
 
         case ast_func: {
-                            std::vector<char *> *sym_table = new vector<char *>();                            
-                            symbol_stack.push_back(sym_table);
+                            // visible in its own body already, for recursion
+                            declare_function(node->func.sym, node->func.param);
+                            cur_func = node;
+                            node->func.locals = createList();
+                            next_slot = 0;
+                            scope_push();
+                            // the next function comes after this one is left
+                            if (node->func.next != NULL) push_visit(node->func.next);
+                            push_action(walk_leave_func);
+                            push_visit(node->func.body);
+                            push_action(walk_enter_body);
                             if (node->func.param != NULL) {
-                                traverseRoot(node->func.param, sym_table);
+                                cur_level = 0;
+                                push_visit(node->func.param);
                             }
-                            traverseRoot(node->func.body, sym_table);
-                            symbol_stack.pop_back();  
                             break;
                         }
         case ast_stmt: {
-                            astStmt stmt = node->stmt;
-                            traverseStmt(&stmt, symbol_table); 
+                            visitStmt(node);
                             break;
                        }
         case ast_var:   {
-                            // check if it is valid
-                            if (stack_lookup(node->var.name) < 0) {
+                            // a hash-consed var is reached once per use, resolve it once
+                            if (node->var.decl != NULL) break;
+                            // check if it is valid and remember what it refers to
+                            node->var.decl = scope_lookup(node->var.sym);
+                            if (node->var.decl == NULL) {
                                 printf("Error: variable {%s} not declared\n", node->var.name); 
                                 exit(-1);
                             }
+                            // take over the unique name of the declaration
+                            node->var.sym = node->var.decl->stmt.decl.sym;
+                            node->var.name = node->var.decl->stmt.decl.name;
+                            node->var.slot = node->var.decl->stmt.decl.slot;
                             break;
                         }
         case ast_bexpr: {
-                            traverseRoot(node->bexpr.lhs, symbol_table);
-                            traverseRoot(node->bexpr.rhs, symbol_table);
+                            push_visit(node->bexpr.rhs);
+                            push_visit(node->bexpr.lhs);
                             break;
                          }
         case ast_rexpr: {
-                            traverseRoot(node->rexpr.lhs, symbol_table);
-                            traverseRoot(node->rexpr.rhs, symbol_table);
+                            push_visit(node->rexpr.rhs);
+                            push_visit(node->rexpr.lhs);
                             break;
                         }
         case ast_cnst:  {
                             break;
                         }
         case ast_uexpr: {
+                            push_visit(node->uexpr.expr);
                             break;
                         }
         case ast_extern: 
@@ -78,64 +250,60 @@ void traverseRoot(astNode *node, vector<char *> *symbol_table) {
 }
 
 
-void traverseStmt(astStmt *stmt, vector<char *> *symbol_table) {
+static void visitStmt(astNode *node) {
 
-    assert(stmt != NULL);
+    assert(node != NULL && node->type == ast_stmt);
+    astStmt *stmt = &(node->stmt);
 
     switch(stmt->type) {
         case ast_block: {
-                            // create new sym_table
-                            vector<char *> *sym_table = new vector<char *>();
-                            symbol_stack.push_back(sym_table);
-                            vector<astNode*> slist = *(stmt->block.stmt_list);
-                            vector<astNode*>::iterator it = slist.begin();
-                            while( it != slist.end()) {
-                                traverseRoot(*it, sym_table);
-                                //symbol_stack.pop_back();
-                                it++;
+                            // open a new scope, closed once all statements are visited
+                            scope_push();
+                            push_action(walk_close_scope);
+                            astList *slist = stmt->block.stmt_list;
+                            for (astList::reverse_iterator it = slist->rbegin(); it != slist->rend(); it++) {
+                                push_visit(*it);
                             }
-                            symbol_stack.pop_back();
                             break;
                         }
         case ast_decl: {
                            // we can only have one declaration
-                            if (symTab_lookup(stmt->decl.name, *symbol_table) == 0){
+                            if (scope_declare(node) < 0){
                                 printf("Error: can only have one declaration in a scope\n");
                                 exit(-1);
-                            } else {
-                                // we add to the symbol table
-                                (*symbol_table).push_back(stmt->decl.name);
                             }
+                            name_decl(node);
                             break;
 
                        }
         case ast_asgn: {
-                            traverseRoot(stmt->asgn.lhs, symbol_table);
-                            traverseRoot(stmt->asgn.rhs, symbol_table);
+                            push_visit(stmt->asgn.rhs);
+                            push_visit(stmt->asgn.lhs);
                             break;
 
                        }
         case ast_while: {
-                            traverseRoot(stmt->whilen.cond, symbol_table);
-                            traverseRoot(stmt->whilen.body, symbol_table);
+                            push_visit(stmt->whilen.body);
+                            push_visit(stmt->whilen.cond);
                             break;
                         }
         case ast_if:    {
-                            traverseRoot(stmt->ifn.cond, symbol_table);
-                            traverseRoot(stmt->ifn.if_body, symbol_table);
                             if (stmt->ifn.else_body != NULL) {
-                                traverseRoot(stmt->ifn.else_body, symbol_table);
+                                push_visit(stmt->ifn.else_body);
                             }
+                            push_visit(stmt->ifn.if_body);
+                            push_visit(stmt->ifn.cond);
                             break;
                         }
         case ast_call:  {
+                            check_call(&(stmt->call));
                             if (stmt->call.param != NULL) {
-                                traverseRoot(stmt->call.param, symbol_table);
+                                push_visit(stmt->call.param);
                             }
                             break;
                         }
         case ast_ret: {
-                          traverseRoot(stmt->ret.expr, symbol_table);
+                          push_visit(stmt->ret.expr);
                           break;
                       }
         default:   {
@@ -147,28 +315,77 @@ void traverseStmt(astStmt *stmt, vector<char *> *symbol_table) {
 
 }
 
-int symTab_lookup(char *symbol, vector<char *> sym_table) {
-    vector<char *>::iterator it = sym_table.begin();
-    while(it != sym_table.end()) {
-        char *sym = *it;
-        if (strcmp(sym, symbol) == 0) {
-            return 0;
+static void walk(astNode *root) {
+    walk_stack.clear();
+    push_visit(root);
+    while (!walk_stack.empty()) {
+        walk_item item = walk_stack.back();
+        walk_stack.pop_back();
+        switch(item.action) {
+            case walk_visit:
+                visit(item.node);
+                break;
+            case walk_close_scope:
+                scope_pop();
+                break;
+            case walk_enter_body:
+                cur_level = 1;
+                break;
+            case walk_leave_func:
+                scope_pop();
+                cur_func = NULL;
+                break;
         }
-        it++;
     }
-    return -1;
+}
 
+void traverseRoot(astNode *node) {
+    walk(node);
 }
 
-int stack_lookup(char *symbol) {
-    vector<vector<char *> *>::iterator it = symbol_stack.end();
-    while (it != symbol_stack.begin()) {
-        it--;
-        vector<char *> *sym_table = *it;
-        if (symTab_lookup(symbol, *sym_table) == 0) {
-            return 0;
-        }
+void traverseStmt(astNode *node) {
+    assert(node != NULL && node->type == ast_stmt);
+    walk(node);
+}
+
+/*
+ * Streaming mode (see stream.c) never has the whole tree: the parser
+ * hands over the parameter and each declaration as it is reduced, and
+ * the statements and conditions to resolve one at a time. Blocks open
+ * and close their scopes with scope_push and scope_pop.
+ */
+void semantic_stream_begin() {
+    reset_functions();
+}
+
+void semantic_stream_func(symId name, astNode *param) {
+    declare_function(name, param);
+    innermost.clear();
+    bindings.clear();
+    scope_starts.clear();
+    unique_id = 0;
+    next_slot = 0;
+    cur_func = NULL;
+    scope_push();
+    if (param != NULL) {
+        cur_level = 0;
+        semantic_stream_declare(param);
     }
+    cur_level = 1;
+}
+
+void semantic_stream_declare(astNode *decl) {
+    if (scope_declare(decl) < 0) {
+        printf("Error: can only have one declaration in a scope\n");
+        exit(-1);
+    }
+    name_decl(decl);
+}
+
+void semantic_resolve(astNode *node) {
+    walk(node);
+}
 
-    return -1;
+void semantic_stream_func_end() {
+    scope_pop();
 }
@@ -1,12 +1,22 @@
-
 #include "../ast/ast.h"
 
 
 int semantic_analysis(astNode *rootPtr);
-void traverseRoot(astNode *node, vector<char *> *symbol_table);
-void traverseStmt(astStmt *stmt, vector<char *> *symbol_table);
-int stack_lookup(char *symbol);
-int symTab_lookup(char *symbol, vector<char *> sym_table);
+void traverseRoot(astNode *node);
+void traverseStmt(astNode *node);
+
+/* scoped symbol table, see semantic.c */
+void scope_push();
+void scope_pop();
+int scope_declare(astNode *decl);
+astNode* scope_lookup(symId symbol);
+
+/* streaming mode, declarations and statements one at a time */
+void semantic_stream_begin();
+void semantic_stream_func(symId name, astNode *param);
+void semantic_stream_declare(astNode *decl);
+void semantic_resolve(astNode *node);
+void semantic_stream_func_end();
 
 
 
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <vector>
+#include "simplify.h"
+
+/*
+ * Runs on the resolved AST, before any IR exists, so code that can never
+ * run costs neither the IR builder nor the optimizer anything:
+ *  - expression trees whose leaves are all constants become one constant,
+ *    with the 32 bit wrap around of the generated code;
+ *  - an if with a constant condition is replaced by the arm it takes and
+ *    a while (0) loop is removed;
+ *  - statements following a return in the same block are dropped.
+ *
+ * Declarations stay in their function's locals even when their block is
+ * removed, so their slots remain valid; the builder just allocates a
+ * slot nobody uses. Like the other walks this one keeps its own stacks,
+ * so deep nesting and long operator chains do not use native stack.
+ */
+
+static simplifyStats counts;
+
+typedef struct {
+    astNode *node;
+    bool operands_done;
+} fold_frame;
+
+static std::vector<fold_frame> fold_stack;
+static std::vector<astNode*> fold_values;
+static std::vector<astNode*> stmt_work; // statements whose children are still to simplify
+
+static astNode* pop_fold() {
+    astNode *v = fold_values.back();
+    fold_values.pop_back();
+    return v;
+}
+
+// folds l op r into *out; false when the result is not defined in C
+static bool fold_binary(op_type op, int l, int r, int *out) {
+    unsigned a = (unsigned) l, b = (unsigned) r;
+    switch (op) {
+        case add: *out = (int) (a + b); return true;
+        case sub: *out = (int) (a - b); return true;
+        case mul: *out = (int) (a * b); return true;
+        case divide:
+            if (r == 0 || (l == INT_MIN && r == -1)) return false;
+            *out = l / r;
+            return true;
+        default: return false;
+    }
+}
+
+static int fold_relation(rop_type op, int l, int r) {
+    switch (op) {
+        case lt:  return l < r;
+        case gt:  return l > r;
+        case le:  return l <= r;
+        case ge:  return l >= r;
+        case eq:  return l == r;
+        default:  return l != r;
+    }
+}
+
+/*
+ * Returns the expression to use in place of node. Operands that fold are
+ * stored back into their parent; a hash-consed parent may be reached
+ * again through another use, which then finds its operands folded already.
+ */
+static astNode* fold_expr(astNode *node) {
+    if (node == NULL) return NULL;
+    fold_stack.clear();
+    fold_values.clear();
+    fold_frame root = {node, false};
+    fold_stack.push_back(root);
+    while (!fold_stack.empty()) {
+        fold_frame f = fold_stack.back();
+        fold_stack.pop_back();
+        astNode *n = f.node;
+        if (!f.operands_done) {
+            fold_frame self = {n, true};
+            if (n->type == ast_bexpr || n->type == ast_rexpr) {
+                fold_frame l = {n->type == ast_bexpr ? n->bexpr.lhs : n->rexpr.lhs, false};
+                fold_frame r = {n->type == ast_bexpr ? n->bexpr.rhs : n->rexpr.rhs, false};
+                fold_stack.push_back(self);
+                fold_stack.push_back(r);
+                fold_stack.push_back(l);
+                continue;
+            }
+            if (n->type == ast_uexpr) {
+                fold_frame e = {n->uexpr.expr, false};
+                fold_stack.push_back(self);
+                fold_stack.push_back(e);
+                continue;
+            }
+            if (n->type == ast_stmt && n->stmt.call.param != NULL) {
+                // a call, its argument is folded
+                fold_frame e = {n->stmt.call.param, false};
+                fold_stack.push_back(self);
+                fold_stack.push_back(e);
+                continue;
+            }
+            // variables, constants and calls without argument are leaves
+            fold_values.push_back(n);
+            continue;
+        }
+
+        if (n->type == ast_stmt) {
+            n->stmt.call.param = pop_fold();
+            fold_values.push_back(n);
+            continue;
+        }
+        if (n->type == ast_uexpr) {
+            astNode *e = pop_fold();
+            if (e->type == ast_cnst && n->uexpr.op == uminus) {
+                counts.folded++;
+                fold_values.push_back(createCnst((int) (0u - (unsigned) e->cnst.value)));
+                continue;
+            }
+            n->uexpr.expr = e;
+            fold_values.push_back(n);
+            continue;
+        }
+
+        astNode *r = pop_fold();
+        astNode *l = pop_fold();
+        if (l->type == ast_cnst && r->type == ast_cnst) {
+            int value;
+            bool folded = true;
+            if (n->type == ast_rexpr)
+                value = fold_relation(n->rexpr.op, l->cnst.value, r->cnst.value);
+            else
+                folded = fold_binary(n->bexpr.op, l->cnst.value, r->cnst.value, &value);
+            if (folded) {
+                counts.folded++;
+                fold_values.push_back(createCnst(value));
+                continue;
+            }
+        }
+        if (n->type == ast_bexpr) {
+            n->bexpr.lhs = l;
+            n->bexpr.rhs = r;
+        } else {
+            n->rexpr.lhs = l;
+            n->rexpr.rhs = r;
+        }
+        fold_values.push_back(n);
+    }
+    return pop_fold();
+}
+
+/*
+ * Simplifies the statement in *slot itself; statements nested in it are
+ * queued on stmt_work. A statement that turns out to do nothing becomes
+ * NULL in a block's list and an empty block anywhere else, where the
+ * builder and the printer expect a statement.
+ */
+static void simplify_slot(astNode **slot, bool in_list) {
+    for (;;) {
+        astNode *node = *slot;
+        if (node == NULL) return;
+        if (node->type != ast_stmt) {
+            *slot = fold_expr(node);
+            return;
+        }
+        astStmt *s = &(node->stmt);
+        switch (s->type) {
+            case ast_asgn:
+                s->asgn.rhs = fold_expr(s->asgn.rhs);
+                return;
+            case ast_call:
+                s->call.param = fold_expr(s->call.param);
+                return;
+            case ast_ret:
+                s->ret.expr = fold_expr(s->ret.expr);
+                return;
+            case ast_while: {
+                astNode *cond = fold_expr(s->whilen.cond);
+                if (cond->type == ast_cnst && cond->cnst.value == 0) {
+                    counts.pruned++;
+                    *slot = in_list ? NULL : createBlock(createList());
+                    return;
+                }
+                // a loop that never exits keeps its comparison, the builder
+                // branches on an i1
+                if (cond->type != ast_cnst) s->whilen.cond = cond;
+                stmt_work.push_back(node);
+                return;
+            }
+            case ast_if: {
+                astNode *cond = fold_expr(s->ifn.cond);
+                if (cond->type == ast_cnst) {
+                    // the arm taken replaces the if and is simplified in its place
+                    counts.pruned++;
+                    astNode *arm = cond->cnst.value != 0 ? s->ifn.if_body : s->ifn.else_body;
+                    *slot = arm != NULL || in_list ? arm : createBlock(createList());
+                    continue;
+                }
+                s->ifn.cond = cond;
+                stmt_work.push_back(node);
+                return;
+            }
+            case ast_block:
+                stmt_work.push_back(node);
+                return;
+            default:
+                return;
+        }
+    }
+}
+
+static void simplify_children(astNode *node) {
+    astStmt *s = &(node->stmt);
+    switch (s->type) {
+        case ast_while:
+            simplify_slot(&s->whilen.body, false);
+            break;
+        case ast_if:
+            simplify_slot(&s->ifn.if_body, false);
+            if (s->ifn.else_body != NULL) simplify_slot(&s->ifn.else_body, false);
+            break;
+        case ast_block: {
+            astList *list = s->block.stmt_list;
+            for (size_t i = 0; i < list->size(); i++)
+                simplify_slot(&(*list)[i], true);
+            // drop removed statements and whatever follows the first return
+            size_t kept = 0;
+            for (size_t i = 0; i < list->size(); i++) {
+                astNode *n = (*list)[i];
+                if (n == NULL) continue;
+                (*list)[kept++] = n;
+                if (n->type == ast_stmt && n->stmt.type == ast_ret) {
+                    for (size_t j = i + 1; j < list->size(); j++)
+                        if ((*list)[j] != NULL) counts.pruned++;
+                    break;
+                }
+            }
+            list->resize(kept);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void simplify(astNode *root) {
+    counts.folded = counts.pruned = 0;
+    if (root == NULL || root->type != ast_prog) return;
+
+    for (astNode *func = root->prog.func; func != NULL; func = func->func.next) {
+        stmt_work.clear();
+        simplify_slot(&func->func.body, false);
+        while (!stmt_work.empty()) {
+            astNode *node = stmt_work.back();
+            stmt_work.pop_back();
+            simplify_children(node);
+        }
+    }
+}
+
+simplifyStats simplifyCounts() {
+    return counts;
+}
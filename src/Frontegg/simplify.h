@@ -0,0 +1,16 @@
+#include "../ast/ast.h"
+
+/*
+ * AST simplification between semantic analysis and the IR builder, see
+ * simplify.c. Folds constant expressions, prunes if arms and while loops
+ * whose condition is constant and drops statements after a return.
+ */
+void simplify(astNode *root);
+
+/* what the last simplify call did, for -stats */
+typedef struct {
+    size_t folded;  // expression nodes replaced by a constant
+    size_t pruned;  // statements removed or replaced by one of their arms
+} simplifyStats;
+
+simplifyStats simplifyCounts();
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <vector>
+#include "stream.h"
+#include "semantic.h"
+#include "builder.h"
+
+/*
+ * Glue between the parser actions and the semantic and IR building
+ * steps in streaming mode. Every statement is resolved and lowered once
+ * it is reduced, and everything the parser allocated for it is given
+ * back by rewinding the AST arena. What stays allocated is the
+ * declarations of the blocks that are still open, so AST memory grows
+ * with the nesting depth of the program, not its size.
+ *
+ * Marks in the arena follow the parse: block_marks has one per open
+ * block, taken before its declarations, and stmt_mark is where the next
+ * statement starts, after the last declaration.
+ */
+
+bool stream_mode = false;
+
+static std::vector<astArenaMark> block_marks;
+static astArenaMark func_mark;
+static astArenaMark stmt_mark;
+
+static astArena* arena() {
+    astArena *a = getAstArena();
+    // the statements are released by rewinding, which needs an arena
+    assert(a != NULL);
+    return a;
+}
+
+// drops the nodes of the statement or condition just lowered
+static void release() {
+    arenaRewind(arena(), stmt_mark);
+}
+
+void stream_begin() {
+    block_marks.clear();
+    semantic_stream_begin();
+    build_module_begin();
+}
+
+void stream_func_begin(symId name, astNode *param) {
+    func_mark = arenaMark(arena());
+    semantic_stream_func(name, param);
+    build_func_begin(symName(name), param);
+    stmt_mark = arenaMark(arena());
+}
+
+void stream_func_end() {
+    semantic_stream_func_end();
+    build_func_end();
+    arenaRewind(arena(), func_mark);
+}
+
+void stream_block_open() {
+    scope_push();
+    block_marks.push_back(arenaMark(arena()));
+}
+
+void stream_block_close() {
+    scope_pop();
+    stmt_mark = block_marks.back();
+    block_marks.pop_back();
+    release();
+}
+
+void stream_decl(astNode *decl) {
+    semantic_stream_declare(decl);
+    build_local(decl);
+    stmt_mark = arenaMark(arena());
+}
+
+void stream_stmt(astNode *node) {
+    semantic_resolve(node);
+    build_stmt(node);
+    release();
+}
+
+void stream_if_begin(astNode *cond) {
+    semantic_resolve(cond);
+    build_if_begin(cond);
+    release();
+}
+
+void stream_if_else() {
+    build_if_else();
+}
+
+void stream_if_end() {
+    build_if_end();
+}
+
+void stream_while_begin(astNode *cond) {
+    semantic_resolve(cond);
+    build_while_begin(cond);
+    release();
+}
+
+void stream_while_end() {
+    build_while_end();
+}
@@ -0,0 +1,22 @@
+#include "../ast/ast.h"
+
+/*
+ * Single pass compilation, see stream.c. While stream_mode is set the
+ * actions of frontend.y resolve and lower every statement as soon as it
+ * is reduced and build no tree: yyparse leaves *root NULL and the module
+ * is taken from build_module_end once it returns.
+ */
+extern bool stream_mode;
+
+void stream_begin();
+void stream_func_begin(symId name, astNode *param);
+void stream_func_end();
+void stream_block_open();
+void stream_block_close();
+void stream_decl(astNode *decl);
+void stream_stmt(astNode *node);
+void stream_if_begin(astNode *cond);
+void stream_if_else();
+void stream_if_end();
+void stream_while_begin(astNode *cond);
+void stream_while_end();
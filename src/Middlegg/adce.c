@@ -0,0 +1,217 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "adce.h"
+#include "analysis.h"
+
+/* Aggressive dead code elimination: everything is dead until shown live.
+ *
+ * Returns, calls and stores to memory other than the function's own slots
+ * are live from the start. A live instruction makes its operands live
+ * through the use lists, a live load the stores to its slot that can reach
+ * it, and a live phi the branches that pick its incoming value. A block with
+ * something live in it makes the branches it is control dependent on
+ * live: the ones that decide whether it runs, found from the post-dominator
+ * tree. Each instruction is marked once and the stores reaching a load
+ * are found walking back through the blocks, each block's start at most
+ * once per slot, so the walk is linear in all but the number of slots.
+ *
+ * Whatever was not marked is removed. A conditional branch that nothing
+ * depends on jumps straight to its immediate post-dominator instead, so a
+ * loop that computes nothing anyone reads is cut off and its blocks, no
+ * longer reachable, are deleted. A function with a block that never gets
+ * to a return keeps all its branches: a loop that does not end is not
+ * removed.
+ */
+
+static const cfgInfo *cfg;
+// the branches each block is control dependent on
+static std::vector<std::vector<unsigned>> controlDeps;
+static std::vector<bool> blockLive;
+static std::unordered_set<LLVMValueRef> live;
+static std::vector<LLVMValueRef> worklist;
+// the store to the same slot before a load in its block, if any
+static std::unordered_map<LLVMValueRef, LLVMValueRef> storeBefore;
+// the last store to each slot in a block, and the slots whose stores
+// reaching the start of the block are found already
+static std::vector<std::unordered_map<LLVMValueRef, LLVMValueRef>> lastStore;
+static std::vector<std::unordered_set<LLVMValueRef>> reachedStart;
+static std::vector<unsigned> walk;
+
+static void mark(LLVMValueRef i) {
+	if (live.insert(i).second) worklist.push_back(i);
+}
+
+static bool reachable(LLVMBasicBlockRef bb) {
+	return cfg->order.count(bb) != 0;
+}
+
+// marks the stores to slot that reach the start of block b
+static void markReaching(LLVMValueRef slot, unsigned b) {
+	walk.clear();
+	walk.push_back(b);
+	while (!walk.empty()) {
+		unsigned c = walk.back();
+		walk.pop_back();
+		if (!reachedStart[c].insert(slot).second) continue;
+		for (unsigned p : cfg->preds[c]) {
+			std::unordered_map<LLVMValueRef, LLVMValueRef>::iterator it = lastStore[p].find(slot);
+			if (it != lastStore[p].end()) mark(it->second);
+			else walk.push_back(p);
+		}
+	}
+}
+
+static void propagate() {
+	while (!worklist.empty()) {
+		LLVMValueRef i = worklist.back();
+		worklist.pop_back();
+		unsigned b = cfg->order.at(LLVMGetInstructionParent(i));
+		if (!blockLive[b]) {
+			blockLive[b] = true;
+			for (unsigned c : controlDeps[b])
+				mark(LLVMGetBasicBlockTerminator(cfg->rpo[c]));
+		}
+		for (int k = 0; k < LLVMGetNumOperands(i); k++) {
+			LLVMValueRef op = LLVMGetOperand(i, k);
+			if (LLVMIsAInstruction(op)) mark(op);
+		}
+		if (LLVMIsAPHINode(i)) {
+			for (unsigned k = 0; k < LLVMCountIncoming(i); k++) {
+				LLVMBasicBlockRef in = LLVMGetIncomingBlock(i, k);
+				if (reachable(in)) mark(LLVMGetBasicBlockTerminator(in));
+			}
+		} else if (LLVMIsALoadInst(i)) {
+			std::unordered_map<LLVMValueRef, LLVMValueRef>::iterator it = storeBefore.find(i);
+			if (it == storeBefore.end()) continue;
+			if (it->second != NULL) mark(it->second);
+			else markReaching(LLVMGetOperand(i, 0), b);
+		}
+	}
+}
+
+static bool isConditional(LLVMValueRef term) {
+	return LLVMIsABranchInst(term) && LLVMIsConditional(term);
+}
+
+static bool hasLivePhi(LLVMBasicBlockRef bb) {
+	for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i && LLVMIsAPHINode(i); i = LLVMGetNextInstruction(i))
+		if (live.count(i)) return true;
+	return false;
+}
+
+bool aggressiveDCE(LLVMValueRef function) {
+	cfg = &getAnalyses(function, POST_DOMINATORS)->cfg;
+	unsigned n = cfg->rpo.size();
+	if (n == 0) return false;
+
+	// b is control dependent on a branch in a when b post-dominates one of
+	// a's successors but not a itself: walk up from each successor
+	bool endless = false;
+	controlDeps.assign(n, std::vector<unsigned>());
+	for (unsigned a = 0; a < n; a++) {
+		if (cfg->ipdom[a] > n) {
+			endless = true;
+			continue;
+		}
+		if (cfg->succs[a].size() < 2) continue;
+		for (unsigned s : cfg->succs[a]) {
+			for (unsigned r = s; r < n && r != cfg->ipdom[a]; r = cfg->ipdom[r]) {
+				if (controlDeps[r].empty() || controlDeps[r].back() != a)
+					controlDeps[r].push_back(a);
+			}
+		}
+	}
+
+	live.clear();
+	worklist.clear();
+	storeBefore.clear();
+	lastStore.assign(n, std::unordered_map<LLVMValueRef, LLVMValueRef>());
+	reachedStart.assign(n, std::unordered_set<LLVMValueRef>());
+	blockLive.assign(n, false);
+	std::unordered_map<LLVMValueRef, bool> localSlot;
+	for (unsigned b = 0; b < n; b++) {
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i)) {
+			LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+			if (opcode == LLVMStore || opcode == LLVMLoad) {
+				LLVMValueRef slot = LLVMGetOperand(i, opcode == LLVMStore ? 1 : 0);
+				std::unordered_map<LLVMValueRef, bool>::iterator it = localSlot.find(slot);
+				if (it == localSlot.end()) it = localSlot.insert(std::make_pair(slot, isLocalSlot(slot))).first;
+				if (!it->second) {
+					if (opcode == LLVMStore) mark(i);
+					continue;
+				}
+				if (opcode == LLVMStore) {
+					lastStore[b][slot] = i;
+				} else {
+					std::unordered_map<LLVMValueRef, LLVMValueRef>::iterator last = lastStore[b].find(slot);
+					storeBefore[i] = last != lastStore[b].end() ? last->second : NULL;
+				}
+				continue;
+			}
+			switch (opcode) {
+				case LLVMBr:
+					if (endless && LLVMIsConditional(i)) mark(i);
+					break;
+				case LLVMAlloca: case LLVMPHI:
+				case LLVMAdd: case LLVMSub: case LLVMMul:
+				case LLVMSDiv: case LLVMUDiv: case LLVMSRem: case LLVMURem:
+				case LLVMShl: case LLVMLShr: case LLVMAShr:
+				case LLVMAnd: case LLVMOr: case LLVMXor:
+				case LLVMICmp: case LLVMZExt: case LLVMSExt: case LLVMTrunc:
+				case LLVMSelect:
+					break;
+				default:
+					// returns, calls and whatever else we do not know
+					mark(i);
+					break;
+			}
+		}
+	}
+	propagate();
+
+	// a branch can only go to its post-dominator if no live phi there
+	// expects to know where it came from
+	bool more = true;
+	while (more) {
+		more = false;
+		for (unsigned b = 0; b < n; b++) {
+			LLVMValueRef term = LLVMGetBasicBlockTerminator(cfg->rpo[b]);
+			if (!isConditional(term) || live.count(term)) continue;
+			if (cfg->ipdom[b] >= n || hasLivePhi(cfg->rpo[cfg->ipdom[b]])) {
+				mark(term);
+				more = true;
+			}
+		}
+		propagate();
+	}
+
+	bool changed = false, branched = false;
+	LLVMBuilderRef builder = LLVMCreateBuilderInContext(LLVMGetModuleContext(LLVMGetGlobalParent(function)));
+	std::vector<LLVMValueRef> dead;
+	for (unsigned b = 0; b < n; b++) {
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i)) {
+			if (live.count(i)) continue;
+			if (isConditional(i)) {
+				LLVMPositionBuilderBefore(builder, i);
+				LLVMBuildBr(builder, cfg->rpo[cfg->ipdom[b]]);
+				dead.push_back(i);
+				branched = true;
+			} else if (!LLVMIsATerminatorInst(i)) {
+				dead.push_back(i);
+			}
+		}
+	}
+	LLVMDisposeBuilder(builder);
+	// dead values are only used by dead instructions
+	for (LLVMValueRef i : dead) {
+		if (LLVMGetFirstUse(i) != NULL) LLVMReplaceAllUsesWith(i, LLVMGetUndef(LLVMTypeOf(i)));
+		LLVMInstructionEraseFromParent(i);
+		changed = true;
+	}
+
+	// the blocks only the removed branches led to
+	if (changed) branched |= removeUnreachable(function);
+	if (branched) preserveAnalyses(function, NO_ANALYSES);
+	return changed;
+}
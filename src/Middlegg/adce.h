@@ -0,0 +1,11 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+/*
+ * Aggressive dead code elimination, see adce.c. Keeps only what a return,
+ * a call or a store that is read again depends on, loops and branches
+ * included, and removes the rest.
+ */
+bool aggressiveDCE(LLVMValueRef function);
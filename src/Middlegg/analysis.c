@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <unordered_map>
+#include "analysis.h"
+
+static std::unordered_map<LLVMValueRef, functionAnalyses> cache;
+static analysisStats counts;
+
+/* Dominance frontiers after Cooper, Harvey and Kennedy: a join block is in
+ * the frontier of each block on the dominator chains of its predecessors
+ * up to, not including, its own immediate dominator.
+ */
+static void buildFrontiers(functionAnalyses *a) {
+	const cfgInfo &cfg = a->cfg;
+	unsigned n = cfg.rpo.size();
+	a->frontier.assign(n, std::vector<unsigned>());
+	for (unsigned b = 0; b < n; b++) {
+		if (cfg.preds[b].size() < 2) continue;
+		for (unsigned p : cfg.preds[b]) {
+			for (unsigned r = p; r != cfg.idom[b]; r = cfg.idom[r]) {
+				if (!a->frontier[r].empty() && a->frontier[r].back() == b) break;
+				a->frontier[r].push_back(b);
+			}
+		}
+	}
+}
+
+static bool dominates(const cfgInfo &cfg, unsigned a, unsigned b) {
+	// a dominator has a lower number than the blocks it dominates
+	while (b > a) b = cfg.idom[b];
+	return a == b;
+}
+
+/* An edge to a block that dominates its source is a back edge, and the
+ * loop it closes is its target and all that reaches the source without
+ * going through the target. Loops with the same header are one. Natural
+ * loops are nested or apart, so the bigger of two that share a block
+ * holds the other; going from the biggest down, the innermost loop of a
+ * block is the last one it turns up in.
+ */
+static void buildLoops(functionAnalyses *a) {
+	const cfgInfo &cfg = a->cfg;
+	unsigned n = cfg.rpo.size();
+	a->loops.clear();
+	a->loopOf.assign(n, -1);
+
+	std::vector<int> loopAt(n, -1);
+	std::vector<unsigned> marked(n, n), walk;
+	for (unsigned h = 0; h < n; h++) {
+		for (unsigned t : cfg.preds[h]) {
+			if (!dominates(cfg, h, t)) continue;
+			if (loopAt[h] < 0) {
+				loopAt[h] = a->loops.size();
+				naturalLoop l = {h, std::vector<unsigned>(1, h), -1, 0};
+				a->loops.push_back(l);
+				marked[h] = h;
+			}
+			std::vector<unsigned> &blocks = a->loops[loopAt[h]].blocks;
+			walk.assign(1, t);
+			while (!walk.empty()) {
+				unsigned b = walk.back();
+				walk.pop_back();
+				if (marked[b] == h) continue;
+				marked[b] = h;
+				blocks.push_back(b);
+				for (unsigned p : cfg.preds[b]) walk.push_back(p);
+			}
+		}
+	}
+
+	std::stable_sort(a->loops.begin(), a->loops.end(), [](const naturalLoop &x, const naturalLoop &y) {
+		return x.blocks.size() > y.blocks.size();
+	});
+	for (unsigned k = 0; k < a->loops.size(); k++) {
+		naturalLoop &l = a->loops[k];
+		l.parent = a->loopOf[l.header];
+		l.depth = l.parent < 0 ? 1 : a->loops[l.parent].depth + 1;
+		for (unsigned b : l.blocks) a->loopOf[b] = k;
+	}
+}
+
+const functionAnalyses *getAnalyses(LLVMValueRef function, analysisSet wanted) {
+	functionAnalyses &a = cache[function];
+	// what each is built from
+	if (wanted & (DOMINANCE_FRONTIERS | LOOPS)) wanted |= DOMINATORS;
+	if (wanted & (DOMINATORS | POST_DOMINATORS)) wanted |= CFG_ANALYSIS;
+
+	analysisSet missing = wanted & ~a.valid;
+	for (analysisSet k = 1; k <= ALL_ANALYSES; k <<= 1) {
+		if (missing & k) counts.computed++;
+		else if (wanted & k) counts.cached++;
+	}
+	if (missing & CFG_ANALYSIS) buildCFG(function, &a.cfg);
+	if (missing & DOMINATORS) buildDominators(&a.cfg);
+	if (missing & POST_DOMINATORS) buildPostDominators(&a.cfg);
+	if (missing & DOMINANCE_FRONTIERS) buildFrontiers(&a);
+	if (missing & LOOPS) buildLoops(&a);
+	a.valid |= missing;
+	return &a;
+}
+
+void preserveAnalyses(LLVMValueRef function, analysisSet preserved) {
+	std::unordered_map<LLVMValueRef, functionAnalyses>::iterator it = cache.find(function);
+	if (it == cache.end()) return;
+	// nothing holds without the blocks it is about
+	if (!(preserved & CFG_ANALYSIS)) preserved = NO_ANALYSES;
+	else if (!(preserved & DOMINATORS)) preserved &= ~(DOMINANCE_FRONTIERS | LOOPS);
+	it->second.valid &= preserved;
+}
+
+void forgetAnalyses() {
+	cache.clear();
+}
+
+analysisStats analysisCounts() {
+	return counts;
+}
@@ -0,0 +1,67 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdio.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+#include <vector>
+#include "cfg.h"
+
+/*
+ * The analyses of a function's control flow, see analysis.c. Each is
+ * computed the first time a pass asks for it, along with the ones it is
+ * built from, and kept until a pass that changes the control flow says
+ * it no longer holds.
+ */
+typedef unsigned analysisSet;
+
+#define CFG_ANALYSIS		1u	// cfgInfo's rpo, order, preds and succs
+#define DOMINATORS		2u	// cfgInfo's idom and domChildren
+#define POST_DOMINATORS		4u	// cfgInfo's ipdom
+#define DOMINANCE_FRONTIERS	8u
+#define LOOPS			16u
+#define NO_ANALYSES		0u
+#define ALL_ANALYSES		31u
+
+typedef struct {
+	unsigned header;
+	// the blocks of the loop, the header first and inner loops' included
+	std::vector<unsigned> blocks;
+	// the loop this one is nested in, -1 for none, and how many loops
+	// deep it is, 1 for an outermost one
+	int parent;
+	unsigned depth;
+} naturalLoop;
+
+typedef struct {
+	cfgInfo cfg;
+	// the blocks where each block's dominance ends
+	std::vector<std::vector<unsigned>> frontier;
+	// the natural loops, each before the ones nested in it
+	std::vector<naturalLoop> loops;
+	// the innermost loop of each block, -1 outside of any
+	std::vector<int> loopOf;
+	analysisSet valid;
+} functionAnalyses;
+
+// the analyses of function, at least those in wanted up to date
+const functionAnalyses *getAnalyses(LLVMValueRef function, analysisSet wanted);
+
+/* to be called by a pass that changed function: what is not in preserved
+   is computed again the next time it is asked for. A pass that changes
+   instructions only keeps all of them, one that adds or removes an edge
+   or a block none */
+void preserveAnalyses(LLVMValueRef function, analysisSet preserved);
+
+// drops all that is cached, the functions may go away after this
+void forgetAnalyses();
+
+/* how many analyses were computed so far and how many times one was
+   asked for and was there already, for -stats */
+typedef struct {
+	size_t computed, cached;
+} analysisStats;
+
+analysisStats analysisCounts();
+
+#endif
@@ -0,0 +1,245 @@
+#include <unordered_set>
+#include "cfg.h"
+
+/* Numbers the blocks reachable from the entry in reverse postorder and
+ * collects their predecessors. The depth first walk keeps its own stack,
+ * a chain of thousands of nested blocks would overflow the call stack.
+ */
+void buildCFG(LLVMValueRef func, cfgInfo *cfg) {
+	cfg->rpo.clear();
+	cfg->order.clear();
+	cfg->preds.clear();
+	cfg->succs.clear();
+	cfg->idom.clear();
+	cfg->domChildren.clear();
+	cfg->ipdom.clear();
+	if (LLVMCountBasicBlocks(func) == 0) return;
+
+	std::vector<LLVMBasicBlockRef> post;
+	std::vector<std::pair<LLVMBasicBlockRef, unsigned>> stack;
+	std::unordered_set<LLVMBasicBlockRef> seen;
+	LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(func);
+	stack.push_back(std::make_pair(entry, 0u));
+	seen.insert(entry);
+	while (!stack.empty()) {
+		LLVMBasicBlockRef bb = stack.back().first;
+		unsigned next = stack.back().second;
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(bb);
+		if (term != NULL && next < LLVMGetNumSuccessors(term)) {
+			stack.back().second++;
+			LLVMBasicBlockRef succ = LLVMGetSuccessor(term, next);
+			if (seen.insert(succ).second) stack.push_back(std::make_pair(succ, 0u));
+		} else {
+			post.push_back(bb);
+			stack.pop_back();
+		}
+	}
+
+	cfg->rpo.assign(post.rbegin(), post.rend());
+	for (unsigned i = 0; i < cfg->rpo.size(); i++)
+		cfg->order[cfg->rpo[i]] = i;
+	cfg->preds.resize(cfg->rpo.size());
+	cfg->succs.resize(cfg->rpo.size());
+	for (unsigned i = 0; i < cfg->rpo.size(); i++) {
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(cfg->rpo[i]);
+		for (unsigned k = 0; term != NULL && k < LLVMGetNumSuccessors(term); k++) {
+			unsigned s = cfg->order[LLVMGetSuccessor(term, k)];
+			cfg->preds[s].push_back(i);
+			cfg->succs[i].push_back(s);
+		}
+	}
+}
+
+/* Immediate dominators after Cooper, Harvey and Kennedy, "A Simple, Fast
+ * Dominance Algorithm": going over the blocks in reverse postorder, a
+ * block's dominator is where the dominator chains of its predecessors
+ * meet. A lower number is closer to the entry on every chain, so two
+ * fingers walk up until they agree. The loop runs again only for back
+ * edges, which are seldom more than a couple of times.
+ */
+void buildDominators(cfgInfo *cfg) {
+	unsigned n = cfg->rpo.size();
+	const unsigned undefined = n;
+	cfg->idom.assign(n, undefined);
+	cfg->domChildren.assign(n, std::vector<unsigned>());
+	if (n == 0) return;
+	cfg->idom[0] = 0;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (unsigned b = 1; b < n; b++) {
+			unsigned dom = undefined;
+			for (unsigned p : cfg->preds[b]) {
+				if (cfg->idom[p] == undefined) continue;
+				if (dom == undefined) {
+					dom = p;
+					continue;
+				}
+				unsigned f1 = p, f2 = dom;
+				while (f1 != f2) {
+					while (f1 > f2) f1 = cfg->idom[f1];
+					while (f2 > f1) f2 = cfg->idom[f2];
+				}
+				dom = f1;
+			}
+			if (cfg->idom[b] != dom) {
+				cfg->idom[b] = dom;
+				changed = true;
+			}
+		}
+	}
+
+	for (unsigned b = 1; b < n; b++)
+		cfg->domChildren[cfg->idom[b]].push_back(b);
+}
+
+/* The same on the reversed graph, from an exit that every block without
+ * successors goes to. The blocks are numbered in reverse postorder of a
+ * walk back from the exit, so that the fingers can climb as above.
+ */
+void buildPostDominators(cfgInfo *cfg) {
+	unsigned n = cfg->rpo.size();
+	const unsigned exit = n, never = n + 1;
+	cfg->ipdom.assign(n, never);
+	if (n == 0) return;
+
+	// the reverse graph's successors of a block are its predecessors,
+	// the exit's are the blocks that return
+	std::vector<unsigned> post;
+	std::vector<bool> seen(n + 1, false);
+	std::vector<std::pair<unsigned, unsigned>> stack;
+	std::vector<unsigned> exits;
+	for (unsigned b = 0; b < n; b++)
+		if (cfg->succs[b].empty()) exits.push_back(b);
+	stack.push_back(std::make_pair(exit, 0u));
+	seen[exit] = true;
+	while (!stack.empty()) {
+		unsigned b = stack.back().first;
+		unsigned next = stack.back().second;
+		const std::vector<unsigned> &to = b == exit ? exits : cfg->preds[b];
+		if (next < to.size()) {
+			stack.back().second++;
+			if (!seen[to[next]]) {
+				seen[to[next]] = true;
+				stack.push_back(std::make_pair(to[next], 0u));
+			}
+		} else {
+			post.push_back(b);
+			stack.pop_back();
+		}
+	}
+
+	// number[b] is b's place in the reverse postorder, the exit is 0
+	std::vector<unsigned> number(n + 1, never);
+	std::vector<unsigned> rpo(post.rbegin(), post.rend());
+	for (unsigned i = 0; i < rpo.size(); i++) number[rpo[i]] = i;
+	std::vector<unsigned> idom(rpo.size(), never);
+	idom[0] = 0;
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (unsigned i = 1; i < rpo.size(); i++) {
+			unsigned b = rpo[i];
+			unsigned dom = never;
+			unsigned count = cfg->succs[b].empty() ? 1 : cfg->succs[b].size();
+			for (unsigned k = 0; k < count; k++) {
+				unsigned p = cfg->succs[b].empty() ? 0 : number[cfg->succs[b][k]];
+				if (p == never || idom[p] == never) continue;
+				if (dom == never) {
+					dom = p;
+					continue;
+				}
+				unsigned f1 = p, f2 = dom;
+				while (f1 != f2) {
+					while (f1 > f2) f1 = idom[f1];
+					while (f2 > f1) f2 = idom[f2];
+				}
+				dom = f1;
+			}
+			if (idom[i] != dom) {
+				idom[i] = dom;
+				changed = true;
+			}
+		}
+	}
+
+	for (unsigned i = 1; i < rpo.size(); i++)
+		cfg->ipdom[rpo[i]] = rpo[idom[i]];
+}
+
+// the blocks are numbered in reverse postorder already
+std::vector<unsigned> reversePostorder(const cfgInfo *cfg) {
+	std::vector<unsigned> order(cfg->rpo.size());
+	for (unsigned b = 0; b < order.size(); b++) order[b] = b;
+	return order;
+}
+
+std::vector<unsigned> postorder(const cfgInfo *cfg) {
+	std::vector<unsigned> order(cfg->rpo.size());
+	for (unsigned b = 0; b < order.size(); b++) order[b] = order.size() - 1 - b;
+	return order;
+}
+
+LLVMValueRef phiWithout(LLVMValueRef phi, LLVMBasicBlockRef pred) {
+	LLVMBuilderRef builder = LLVMCreateBuilderInContext(LLVMGetTypeContext(LLVMTypeOf(phi)));
+	LLVMPositionBuilderBefore(builder, phi);
+	LLVMValueRef copy = LLVMBuildPhi(builder, LLVMTypeOf(phi), "");
+	LLVMDisposeBuilder(builder);
+	for (unsigned k = 0; k < LLVMCountIncoming(phi); k++) {
+		LLVMBasicBlockRef in = LLVMGetIncomingBlock(phi, k);
+		if (in == pred) continue;
+		LLVMValueRef v = LLVMGetIncomingValue(phi, k);
+		LLVMAddIncoming(copy, &v, &in, 1);
+	}
+	LLVMReplaceAllUsesWith(phi, copy);
+	return copy;
+}
+
+/* What is in the blocks that go can only be used there or by the phis
+ * they lead to, which lose those values first. The blocks can branch to
+ * each other, so none is deleted before all have lost their terminators.
+ */
+bool removeUnreachable(LLVMValueRef func) {
+	cfgInfo cfg;
+	buildCFG(func, &cfg);
+	std::vector<LLVMBasicBlockRef> gone;
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb))
+		if (cfg.order.count(bb) == 0) gone.push_back(bb);
+	if (gone.empty()) return false;
+
+	for (LLVMBasicBlockRef bb : gone) {
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(bb);
+		for (unsigned k = 0; term != NULL && k < LLVMGetNumSuccessors(term); k++) {
+			LLVMBasicBlockRef succ = LLVMGetSuccessor(term, k);
+			if (cfg.order.count(succ) == 0) continue;
+			LLVMValueRef next;
+			for (LLVMValueRef phi = LLVMGetFirstInstruction(succ); phi && LLVMIsAPHINode(phi); phi = next) {
+				next = LLVMGetNextInstruction(phi);
+				phiWithout(phi, bb);
+				LLVMInstructionEraseFromParent(phi);
+			}
+		}
+	}
+	for (LLVMBasicBlockRef bb : gone)
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i))
+			if (LLVMGetFirstUse(i) != NULL) LLVMReplaceAllUsesWith(i, LLVMGetUndef(LLVMTypeOf(i)));
+	for (LLVMBasicBlockRef bb : gone)
+		if (LLVMGetBasicBlockTerminator(bb) != NULL)
+			LLVMInstructionEraseFromParent(LLVMGetBasicBlockTerminator(bb));
+	for (LLVMBasicBlockRef bb : gone)
+		LLVMDeleteBasicBlock(bb);
+	return true;
+}
+
+bool isLocalSlot(LLVMValueRef v) {
+	if (!LLVMIsAAllocaInst(v)) return false;
+	for (LLVMUseRef u = LLVMGetFirstUse(v); u; u = LLVMGetNextUse(u)) {
+		LLVMValueRef user = LLVMGetUser(u);
+		if (LLVMIsALoadInst(user)) continue;
+		if (LLVMIsAStoreInst(user) && LLVMGetOperand(user, 0) != v) continue;
+		return false;
+	}
+	return true;
+}
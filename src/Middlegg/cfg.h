@@ -0,0 +1,55 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdio.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * The shape of a function's control flow, for the passes that walk it in
+ * order or over the dominator tree. Blocks are numbered by their place in
+ * reverse postorder, the entry block is 0. Blocks that cannot be reached
+ * from the entry are left out.
+ */
+typedef struct {
+	std::vector<LLVMBasicBlockRef> rpo;
+	std::unordered_map<LLVMBasicBlockRef, unsigned> order;
+	std::vector<std::vector<unsigned>> preds;
+	std::vector<std::vector<unsigned>> succs;
+	// immediate dominator of each block, the entry is its own
+	std::vector<unsigned> idom;
+	std::vector<std::vector<unsigned>> domChildren;
+	// immediate post-dominator of each block: the number of blocks for the
+	// exit all returns lead to, one more for a block that never gets there
+	std::vector<unsigned> ipdom;
+} cfgInfo;
+
+void buildCFG(LLVMValueRef func, cfgInfo *cfg);
+void buildDominators(cfgInfo *cfg);
+void buildPostDominators(cfgInfo *cfg);
+
+/*
+ * The block numbers in the orders to go over them in. In reverse
+ * postorder a block comes after its predecessors, but for those along a
+ * back edge; in postorder after its successors the same way, which is
+ * the order for going against the edges.
+ */
+std::vector<unsigned> reversePostorder(const cfgInfo *cfg);
+std::vector<unsigned> postorder(const cfgInfo *cfg);
+
+/*
+ * Editing the control flow. phiWithout puts a copy of phi without the
+ * values from pred in its place and returns it, the old phi is left for
+ * the caller to erase. removeUnreachable deletes the blocks that cannot be
+ * reached from the entry any more.
+ */
+LLVMValueRef phiWithout(LLVMValueRef phi, LLVMBasicBlockRef pred);
+bool removeUnreachable(LLVMValueRef func);
+
+// an alloca only ever loaded from and stored to: nothing but these
+// loads and stores can see what it holds
+bool isLocalSlot(LLVMValueRef v);
+
+#endif
@@ -0,0 +1,329 @@
+#include <unordered_set>
+#include <vector>
+#include "combine.h"
+#include "analysis.h"
+
+/* Peephole simplification from a worklist.
+ *
+ * Every instruction is looked at once. When one is replaced, its users go
+ * back on the worklist, since their operand changed, and so do the
+ * operands of an erased one, which may have lost their last use. Nothing
+ * else is looked at again, so a chain of folds costs one visit per link.
+ *
+ * The rules, with constants kept on the right of commutative operations:
+ *	c1 op c2		the constant, in the width of the instruction
+ *	x + 0, x - 0, x * 1	x
+ *	x * 0, x - x, x ^ x	0
+ *	x * -1			0 - x
+ *	x * 2^k			x << k
+ *	0 - (0 - x)		x
+ *	x + (0 - y), (0 - y) + x	x - y
+ *	x - (0 - y)		x + y
+ *	(0 - x) * (0 - y)	x * y
+ *	x cmp x, c1 cmp c2	true or false
+ *	br c, a, b		br a or br b, for a constant c
+ *	phi [x, ...], [x, ...]	x
+ * A branch that is folded takes its block out of the phis of the target it
+ * no longer goes to, and the blocks that cannot be reached any more are
+ * deleted once the worklist is empty.
+ */
+
+static std::vector<LLVMValueRef> worklist;
+static std::unordered_set<LLVMValueRef> queued;
+static LLVMBuilderRef builder;
+static bool cfgChanged;
+
+static void push(LLVMValueRef v) {
+	if (LLVMIsAInstruction(v) && queued.insert(v).second) worklist.push_back(v);
+}
+
+static void pushUsers(LLVMValueRef v) {
+	for (LLVMUseRef u = LLVMGetFirstUse(v); u; u = LLVMGetNextUse(u))
+		push(LLVMGetUser(u));
+}
+
+static void erase(LLVMValueRef i) {
+	for (int k = 0; k < LLVMGetNumOperands(i); k++)
+		push(LLVMGetOperand(i, k));
+	// a stale entry in the worklist is skipped, it is no longer queued
+	queued.erase(i);
+	LLVMInstructionEraseFromParent(i);
+}
+
+static void replace(LLVMValueRef i, LLVMValueRef v) {
+	pushUsers(i);
+	LLVMReplaceAllUsesWith(i, v);
+	push(v);
+	erase(i);
+}
+
+// no side effects, can go once unused
+static bool isPure(LLVMValueRef i) {
+	switch (LLVMGetInstructionOpcode(i)) {
+		case LLVMAlloca: case LLVMLoad: case LLVMPHI:
+		case LLVMAdd: case LLVMSub: case LLVMMul:
+		case LLVMSDiv: case LLVMUDiv: case LLVMSRem: case LLVMURem:
+		case LLVMShl: case LLVMLShr: case LLVMAShr:
+		case LLVMAnd: case LLVMOr: case LLVMXor:
+		case LLVMICmp: case LLVMZExt: case LLVMSExt: case LLVMTrunc:
+		case LLVMSelect:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool isConst(LLVMValueRef v, long long c) {
+	return LLVMIsAConstantInt(v) && LLVMConstIntGetSExtValue(v) == c;
+}
+
+// 0 - x gives x
+static LLVMValueRef negated(LLVMValueRef v) {
+	if (LLVMIsAInstruction(v) && LLVMGetInstructionOpcode(v) == LLVMSub && isConst(LLVMGetOperand(v, 0), 0))
+		return LLVMGetOperand(v, 1);
+	return NULL;
+}
+
+static bool isCommutative(LLVMOpcode opcode) {
+	return opcode == LLVMAdd || opcode == LLVMMul || opcode == LLVMAnd || opcode == LLVMOr || opcode == LLVMXor;
+}
+
+/* a op b for constants, computed in the bits of the instruction's type;
+ * false for what cannot be folded, a division by zero or an overflowing
+ * one, a shift by the width or more */
+static bool foldBinary(LLVMOpcode opcode, LLVMValueRef a, LLVMValueRef b, unsigned width, unsigned long long *r) {
+	long long sa = LLVMConstIntGetSExtValue(a), sb = LLVMConstIntGetSExtValue(b);
+	unsigned long long ua = LLVMConstIntGetZExtValue(a), ub = LLVMConstIntGetZExtValue(b);
+	long long smin = width >= 64 ? (long long) (1ULL << 63) : -(1LL << (width - 1));
+	switch (opcode) {
+		case LLVMAdd: *r = ua + ub; return true;
+		case LLVMSub: *r = ua - ub; return true;
+		case LLVMMul: *r = ua * ub; return true;
+		case LLVMAnd: *r = ua & ub; return true;
+		case LLVMOr: *r = ua | ub; return true;
+		case LLVMXor: *r = ua ^ ub; return true;
+		case LLVMShl:
+			if (ub >= width) return false;
+			*r = ua << ub;
+			return true;
+		case LLVMLShr:
+			if (ub >= width) return false;
+			*r = ua >> ub;
+			return true;
+		case LLVMAShr:
+			if (ub >= width) return false;
+			*r = sa >> ub;
+			return true;
+		case LLVMSDiv: case LLVMSRem:
+			if (sb == 0 || (sb == -1 && sa == smin)) return false;
+			*r = opcode == LLVMSDiv ? sa / sb : sa % sb;
+			return true;
+		case LLVMUDiv: case LLVMURem:
+			if (ub == 0) return false;
+			*r = opcode == LLVMUDiv ? ua / ub : ua % ub;
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool compare(LLVMIntPredicate p, long long sa, long long sb, unsigned long long ua, unsigned long long ub) {
+	switch (p) {
+		case LLVMIntEQ: return ua == ub;
+		case LLVMIntNE: return ua != ub;
+		case LLVMIntSLT: return sa < sb;
+		case LLVMIntSLE: return sa <= sb;
+		case LLVMIntSGT: return sa > sb;
+		case LLVMIntSGE: return sa >= sb;
+		case LLVMIntULT: return ua < ub;
+		case LLVMIntULE: return ua <= ub;
+		case LLVMIntUGT: return ua > ub;
+		default: return ua >= ub;
+	}
+}
+
+LLVMValueRef foldBinaryConstants(LLVMOpcode opcode, LLVMValueRef a, LLVMValueRef b) {
+	LLVMTypeRef type = LLVMTypeOf(a);
+	unsigned long long r;
+	return foldBinary(opcode, a, b, LLVMGetIntTypeWidth(type), &r) ? LLVMConstInt(type, r, 0) : NULL;
+}
+
+LLVMValueRef foldCompareConstants(LLVMIntPredicate p, LLVMValueRef a, LLVMValueRef b) {
+	bool r = compare(p, LLVMConstIntGetSExtValue(a), LLVMConstIntGetSExtValue(b),
+		LLVMConstIntGetZExtValue(a), LLVMConstIntGetZExtValue(b));
+	return LLVMConstInt(LLVMInt1TypeInContext(LLVMGetTypeContext(LLVMTypeOf(a))), r, 0);
+}
+
+static LLVMValueRef simplifyBinary(LLVMValueRef i, LLVMOpcode opcode) {
+	LLVMValueRef a = LLVMGetOperand(i, 0);
+	LLVMValueRef b = LLVMGetOperand(i, 1);
+	LLVMTypeRef type = LLVMTypeOf(i);
+	if (LLVMIsAConstantInt(a) && LLVMIsAConstantInt(b))
+		return foldBinaryConstants(opcode, a, b);
+
+	LLVMPositionBuilderBefore(builder, i);
+	switch (opcode) {
+		case LLVMAdd:
+			if (isConst(b, 0)) return a;
+			if (negated(b)) return LLVMBuildSub(builder, a, negated(b), "");
+			if (negated(a)) return LLVMBuildSub(builder, b, negated(a), "");
+			return NULL;
+		case LLVMSub:
+			if (isConst(b, 0)) return a;
+			if (a == b) return LLVMConstInt(type, 0, 0);
+			if (isConst(a, 0) && negated(b)) return negated(b);
+			if (negated(b)) return LLVMBuildAdd(builder, a, negated(b), "");
+			return NULL;
+		case LLVMMul: {
+			if (isConst(b, 0)) return b;
+			if (isConst(b, 1)) return a;
+			if (isConst(b, -1)) return LLVMBuildSub(builder, LLVMConstInt(type, 0, 0), a, "");
+			if (negated(a) && negated(b)) return LLVMBuildMul(builder, negated(a), negated(b), "");
+			if (!LLVMIsAConstantInt(b)) return NULL;
+			unsigned long long c = LLVMConstIntGetZExtValue(b);
+			if ((c & (c - 1)) != 0) return NULL;
+			unsigned k = 0;
+			while ((c >> k) != 1) k++;
+			return LLVMBuildShl(builder, a, LLVMConstInt(type, k, 0), "");
+		}
+		case LLVMSDiv: case LLVMUDiv:
+			if (isConst(b, 1)) return a;
+			return NULL;
+		case LLVMSRem: case LLVMURem:
+			if (isConst(b, 1)) return LLVMConstInt(type, 0, 0);
+			return NULL;
+		case LLVMShl: case LLVMLShr: case LLVMAShr:
+			if (isConst(b, 0)) return a;
+			if (isConst(a, 0)) return a;
+			return NULL;
+		case LLVMAnd:
+			if (isConst(b, 0)) return b;
+			if (isConst(b, -1) || a == b) return a;
+			return NULL;
+		case LLVMOr:
+			if (isConst(b, -1)) return b;
+			if (isConst(b, 0) || a == b) return a;
+			return NULL;
+		case LLVMXor:
+			if (isConst(b, 0)) return a;
+			if (a == b) return LLVMConstInt(type, 0, 0);
+			return NULL;
+		default:
+			return NULL;
+	}
+}
+
+static LLVMValueRef simplifyCompare(LLVMValueRef i) {
+	LLVMValueRef a = LLVMGetOperand(i, 0);
+	LLVMValueRef b = LLVMGetOperand(i, 1);
+	LLVMIntPredicate p = LLVMGetICmpPredicate(i);
+	if (a == b) {
+		bool equal = p == LLVMIntEQ || p == LLVMIntSLE || p == LLVMIntSGE || p == LLVMIntULE || p == LLVMIntUGE;
+		return LLVMConstInt(LLVMTypeOf(i), equal, 0);
+	}
+	if (LLVMIsAConstantInt(a) && LLVMIsAConstantInt(b))
+		return foldCompareConstants(p, a, b);
+	return NULL;
+}
+
+/* The incoming value of all edges but the phi's own. It was there at the
+ * end of every predecessor the phi does not come back from, so it is
+ * there wherever the phi is. */
+static LLVMValueRef simplifyPhi(LLVMValueRef i) {
+	LLVMValueRef same = NULL;
+	for (unsigned k = 0; k < LLVMCountIncoming(i); k++) {
+		LLVMValueRef v = LLVMGetIncomingValue(i, k);
+		if (v == i || v == same) continue;
+		if (same != NULL) return NULL;
+		same = v;
+	}
+	return same;
+}
+
+// br on a constant jumps to where it would go
+static bool foldBranch(LLVMValueRef i) {
+	LLVMValueRef cond = LLVMGetOperand(i, 0);
+	if (!LLVMIsAConstantInt(cond)) return false;
+	// operand 2 is the true target, operand 1 the false one
+	LLVMBasicBlockRef taken = LLVMValueAsBasicBlock(LLVMGetOperand(i, LLVMConstIntGetZExtValue(cond) ? 2 : 1));
+	LLVMBasicBlockRef other = LLVMValueAsBasicBlock(LLVMGetOperand(i, LLVMConstIntGetZExtValue(cond) ? 1 : 2));
+	LLVMBasicBlockRef bb = LLVMGetInstructionParent(i);
+	LLVMValueRef first = LLVMGetFirstInstruction(other);
+	// its phis have the block twice, one of the two would have to go
+	if (taken == other && LLVMIsAPHINode(first)) return false;
+	if (taken != other) {
+		LLVMValueRef next;
+		for (LLVMValueRef phi = first; phi && LLVMIsAPHINode(phi); phi = next) {
+			next = LLVMGetNextInstruction(phi);
+			LLVMValueRef copy = phiWithout(phi, bb);
+			push(copy);
+			pushUsers(copy);
+			erase(phi);
+		}
+	}
+	LLVMPositionBuilderBefore(builder, i);
+	LLVMBuildBr(builder, taken);
+	erase(i);
+	cfgChanged = true;
+	return true;
+}
+
+static bool simplify(LLVMValueRef i) {
+	if (isPure(i) && LLVMGetFirstUse(i) == NULL) {
+		erase(i);
+		return true;
+	}
+	LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+	LLVMValueRef v = NULL;
+	switch (opcode) {
+		case LLVMAdd: case LLVMSub: case LLVMMul:
+		case LLVMSDiv: case LLVMUDiv: case LLVMSRem: case LLVMURem:
+		case LLVMShl: case LLVMLShr: case LLVMAShr:
+		case LLVMAnd: case LLVMOr: case LLVMXor:
+			if (isCommutative(opcode) && LLVMIsAConstantInt(LLVMGetOperand(i, 0)) && !LLVMIsAConstantInt(LLVMGetOperand(i, 1))) {
+				LLVMValueRef a = LLVMGetOperand(i, 0);
+				LLVMSetOperand(i, 0, LLVMGetOperand(i, 1));
+				LLVMSetOperand(i, 1, a);
+			}
+			v = simplifyBinary(i, opcode);
+			break;
+		case LLVMICmp:
+			v = simplifyCompare(i);
+			break;
+		case LLVMPHI:
+			v = simplifyPhi(i);
+			break;
+		case LLVMBr:
+			return LLVMIsConditional(i) && foldBranch(i);
+		default:
+			break;
+	}
+	if (v == NULL) return false;
+	replace(i, v);
+	return true;
+}
+
+bool combineInstructions(LLVMValueRef function) {
+	bool changed = false, branched = false;
+	builder = LLVMCreateBuilderInContext(LLVMGetModuleContext(LLVMGetGlobalParent(function)));
+	do {
+		cfgChanged = false;
+		worklist.clear();
+		queued.clear();
+		// the worklist is a stack, so the first instruction goes on last
+		for (LLVMBasicBlockRef bb = LLVMGetLastBasicBlock(function); bb; bb = LLVMGetPreviousBasicBlock(bb))
+			for (LLVMValueRef i = LLVMGetLastInstruction(bb); i; i = LLVMGetPreviousInstruction(i))
+				push(i);
+		while (!worklist.empty()) {
+			LLVMValueRef i = worklist.back();
+			worklist.pop_back();
+			if (queued.erase(i) == 0) continue;
+			changed |= simplify(i);
+		}
+		branched |= cfgChanged;
+		// new phis with fewer values to pick from may fold too
+	} while (cfgChanged && removeUnreachable(function));
+	LLVMDisposeBuilder(builder);
+	if (branched) preserveAnalyses(function, NO_ANALYSES);
+	return changed;
+}
@@ -0,0 +1,18 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+/*
+ * Peephole simplification, see combine.c: folds constants, algebraic
+ * identities and negations, turns multiplications by a power of two into
+ * shifts and branches on a constant into jumps.
+ */
+bool combineInstructions(LLVMValueRef function);
+
+/*
+ * a op b and a compared with b for two integer constants, in their own
+ * width. NULL for what cannot be folded, like a division by zero.
+ */
+LLVMValueRef foldBinaryConstants(LLVMOpcode opcode, LLVMValueRef a, LLVMValueRef b);
+LLVMValueRef foldCompareConstants(LLVMIntPredicate p, LLVMValueRef a, LLVMValueRef b);
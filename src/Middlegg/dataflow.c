@@ -0,0 +1,109 @@
+#include "dataflow.h"
+
+static dataflowStats counts;
+
+/* The slots are the local allocas of the reachable blocks, the inlined
+ * callees' among them, in the order they come. The stores to them are
+ * gathered slot by slot so that each slot's are a run of numbers and one
+ * store kills all the others to its slot a word at a time.
+ */
+void numberSlots(const cfgInfo *cfg, slotNumbering *num) {
+	num->slot.clear();
+	num->slots.clear();
+	num->store.clear();
+	num->stores.clear();
+	num->firstStore.clear();
+	std::vector<std::vector<LLVMValueRef>> bySlot;
+	for (LLVMBasicBlockRef bb : cfg->rpo) {
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i)) {
+			if (LLVMIsAAllocaInst(i) && isLocalSlot(i)) {
+				num->slot[i] = num->slots.size();
+				num->slots.push_back(i);
+				bySlot.push_back(std::vector<LLVMValueRef>());
+			} else if (LLVMIsAStoreInst(i)) {
+				std::unordered_map<LLVMValueRef, unsigned>::iterator it = num->slot.find(LLVMGetOperand(i, 1));
+				if (it != num->slot.end()) bySlot[it->second].push_back(i);
+			}
+		}
+	}
+	for (unsigned s = 0; s < bySlot.size(); s++) {
+		num->firstStore.push_back(num->stores.size());
+		for (LLVMValueRef store : bySlot[s]) {
+			num->store[store] = num->stores.size();
+			num->stores.push_back(store);
+		}
+	}
+	num->firstStore.push_back(num->stores.size());
+}
+
+// the slot a load or store goes to, or -1 for other memory
+static int slotOf(const slotNumbering *num, LLVMValueRef i) {
+	LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+	if (opcode != LLVMLoad && opcode != LLVMStore) return -1;
+	std::unordered_map<LLVMValueRef, unsigned>::const_iterator it = num->slot.find(LLVMGetOperand(i, opcode == LLVMStore ? 1 : 0));
+	return it == num->slot.end() ? -1 : (int) it->second;
+}
+
+static void startSets(const cfgInfo *cfg, unsigned bits, dataflowSets *sets) {
+	unsigned n = cfg->rpo.size();
+	sets->bits = bits;
+	sets->gen.assign(n, bitSet());
+	sets->kill.assign(n, bitSet());
+	for (unsigned b = 0; b < n; b++) {
+		sets->gen[b].clear(bits);
+		sets->kill[b].clear(bits);
+	}
+}
+
+/* A block generates the last store to each slot in it and kills all the
+ * stores to the slots it stores to. Nothing reaches the entry: a slot
+ * read before it is written holds whatever was on the stack.
+ */
+void reachingStores(const cfgInfo *cfg, const slotNumbering *num, dataflowSets *sets) {
+	startSets(cfg, num->stores.size(), sets);
+	std::unordered_map<unsigned, unsigned> last;
+	for (unsigned b = 0; b < cfg->rpo.size(); b++) {
+		last.clear();
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i)) {
+			int s = slotOf(num, i);
+			if (s < 0 || !LLVMIsAStoreInst(i)) continue;
+			unsigned k = num->store.at(i);
+			std::unordered_map<unsigned, unsigned>::iterator it = last.find(s);
+			if (it != last.end()) {
+				sets->gen[b].reset(it->second);
+				it->second = k;
+			} else {
+				last[s] = k;
+				sets->kill[b].setRange(num->firstStore[s], num->firstStore[s + 1]);
+			}
+			sets->gen[b].set(k);
+		}
+	}
+	bitSet none;
+	none.clear(sets->bits);
+	solveDataflow<forwardFlow, unionMeet>(cfg, sets, none);
+}
+
+/* A block generates the slots it loads before storing to them and kills
+ * the ones it stores to. Nothing is live after a return.
+ */
+void liveSlots(const cfgInfo *cfg, const slotNumbering *num, dataflowSets *sets) {
+	startSets(cfg, num->slots.size(), sets);
+	for (unsigned b = 0; b < cfg->rpo.size(); b++) {
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i)) {
+			int s = slotOf(num, i);
+			if (s < 0) continue;
+			if (LLVMIsAStoreInst(i)) sets->kill[b].set(s);
+			else if (!sets->kill[b].test(s)) sets->gen[b].set(s);
+		}
+	}
+	bitSet none;
+	none.clear(sets->bits);
+	solveDataflow<backwardFlow, unionMeet>(cfg, sets, none);
+	counts.liveSolves++;
+	counts.liveVisits += sets->visits;
+}
+
+dataflowStats dataflowCounts() {
+	return counts;
+}
@@ -0,0 +1,155 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdint.h>
+#include <functional>
+#include <queue>
+#include <vector>
+#include "cfg.h"
+
+/*
+ * A set of densely numbered things, 64 to a word, so that union and
+ * difference go a word at a time. All the sets of one problem have the
+ * same size.
+ */
+typedef struct bitSet {
+	std::vector<uint64_t> words;
+
+	void clear(unsigned bits) { words.assign((bits + 63) / 64, 0); }
+	void fill(unsigned bits) {
+		words.assign((bits + 63) / 64, ~(uint64_t) 0);
+		if (bits % 64) words.back() = ((uint64_t) 1 << bits % 64) - 1;
+	}
+	bool test(unsigned i) const { return words[i / 64] >> i % 64 & 1; }
+	void set(unsigned i) { words[i / 64] |= (uint64_t) 1 << i % 64; }
+	void reset(unsigned i) { words[i / 64] &= ~((uint64_t) 1 << i % 64); }
+	// bits from up to to, not including to
+	void setRange(unsigned from, unsigned to) {
+		while (from < to && from % 64) set(from++);
+		for (; from + 64 <= to; from += 64) words[from / 64] = ~(uint64_t) 0;
+		while (from < to) set(from++);
+	}
+	void meetUnion(const bitSet &o) {
+		for (size_t w = 0; w < words.size(); w++) words[w] |= o.words[w];
+	}
+	void meetIntersection(const bitSet &o) {
+		for (size_t w = 0; w < words.size(); w++) words[w] &= o.words[w];
+	}
+	// this = gen | (from & ~kill), whether anything changed
+	bool transfer(const bitSet &gen, const bitSet &from, const bitSet &kill) {
+		uint64_t diff = 0;
+		for (size_t w = 0; w < words.size(); w++) {
+			uint64_t now = gen.words[w] | (from.words[w] & ~kill.words[w]);
+			diff |= now ^ words[w];
+			words[w] = now;
+		}
+		return diff != 0;
+	}
+} bitSet;
+
+enum dataflowDirection { forwardFlow, backwardFlow };
+enum dataflowMeet { unionMeet, intersectionMeet };
+
+/*
+ * The sets of one problem, by block number (see cfg.h). in is at the
+ * start of a block and out at its end, whatever the direction. visits
+ * is how many times the solver went over a block to get them.
+ */
+typedef struct {
+	unsigned bits;
+	std::vector<bitSet> gen, kill, in, out;
+	size_t visits;
+} dataflowSets;
+
+/* Solves a gen/kill problem over the blocks of cfg: what flows into a
+ * block is the meet of what its predecessors (forward) or successors
+ * (backward) give it, boundary at the entry or at the blocks that return,
+ * and it leaves gen | (that & ~kill). Every block is visited once, in
+ * reverse postorder forward and in postorder backward, so that a block
+ * mostly comes after the ones it gets its sets from. After that only the
+ * blocks whose sets could change, the ones after a block whose set did,
+ * are visited again, still earliest in that order first.
+ */
+template <dataflowDirection direction, dataflowMeet meet>
+void solveDataflow(const cfgInfo *cfg, dataflowSets *sets, const bitSet &boundary) {
+	unsigned n = cfg->rpo.size();
+	std::vector<bitSet> &into = direction == forwardFlow ? sets->in : sets->out;
+	std::vector<bitSet> &from = direction == forwardFlow ? sets->out : sets->in;
+	const std::vector<std::vector<unsigned>> &edges = direction == forwardFlow ? cfg->preds : cfg->succs;
+	const std::vector<std::vector<unsigned>> &dependents = direction == forwardFlow ? cfg->succs : cfg->preds;
+	into.assign(n, bitSet());
+	from.assign(n, bitSet());
+	for (unsigned b = 0; b < n; b++) {
+		into[b].clear(sets->bits);
+		// the top of the lattice: everything for an intersection
+		if (meet == unionMeet) from[b].clear(sets->bits);
+		else from[b].fill(sets->bits);
+	}
+
+	// the worklist holds places in the order, lowest first
+	std::vector<unsigned> order = direction == forwardFlow ? reversePostorder(cfg) : postorder(cfg);
+	std::vector<unsigned> place(n);
+	std::priority_queue<unsigned, std::vector<unsigned>, std::greater<unsigned>> work;
+	std::vector<bool> queued(n, true);
+	for (unsigned k = 0; k < n; k++) {
+		place[order[k]] = k;
+		work.push(k);
+	}
+	sets->visits = 0;
+	while (!work.empty()) {
+		unsigned b = order[work.top()];
+		work.pop();
+		queued[b] = false;
+		sets->visits++;
+		if (edges[b].empty() || (direction == forwardFlow && b == 0)) {
+			into[b] = boundary;
+		} else {
+			into[b] = from[edges[b][0]];
+			for (size_t e = 1; e < edges[b].size(); e++) {
+				if (meet == unionMeet) into[b].meetUnion(from[edges[b][e]]);
+				else into[b].meetIntersection(from[edges[b][e]]);
+			}
+		}
+		if (!from[b].transfer(sets->gen[b], into[b], sets->kill[b])) continue;
+		for (unsigned d : dependents[b]) {
+			if (queued[d]) continue;
+			queued[d] = true;
+			work.push(place[d]);
+		}
+	}
+}
+
+/*
+ * The local slots (see isLocalSlot) of a function and the stores to them,
+ * numbered densely. The stores are numbered slot by slot, those to slot s
+ * are firstStore[s] up to firstStore[s + 1].
+ */
+typedef struct {
+	std::unordered_map<LLVMValueRef, unsigned> slot;
+	std::vector<LLVMValueRef> slots;
+	std::unordered_map<LLVMValueRef, unsigned> store;
+	std::vector<LLVMValueRef> stores;
+	std::vector<unsigned> firstStore;
+} slotNumbering;
+
+void numberSlots(const cfgInfo *cfg, slotNumbering *num);
+
+/*
+ * Problems over the slots, see dataflow.c. reachingStores has a bit for
+ * each store, set where the store can be the last one to its slot; no
+ * pass uses it since constant propagation moved to sccp.c, only
+ * dataflowbench. liveSlots has a bit for each slot, set where a load can
+ * still read what the slot holds, for dead store elimination.
+ */
+void reachingStores(const cfgInfo *cfg, const slotNumbering *num, dataflowSets *sets);
+void liveSlots(const cfgInfo *cfg, const slotNumbering *num, dataflowSets *sets);
+
+/* how often liveness was solved so far and the blocks the solver
+   visited for it, for -stats */
+typedef struct {
+	size_t liveSolves, liveVisits;
+} dataflowStats;
+
+dataflowStats dataflowCounts();
+
+#endif
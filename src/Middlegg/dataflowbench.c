@@ -0,0 +1,200 @@
+/*
+Time and peak memory of the bit set dataflow problems (dataflow.c)
+against the std::set liveness livevarAnalysis had before them, on
+functions of many small blocks with loops. Each runs in a process of
+its own so that the peak resident size is its own; "build" only builds
+the function, for reference.
+Build with `make dataflowbench` and run
+	./dataflowbench [blocks...]
+The std::set liveness is only run up to 10000 blocks.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "dataflow.h"
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned seed = 1;
+
+static unsigned rnd(unsigned n){
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+/* The liveness before dataflow.c, as it was: std::set of the loads, the
+ * whole sets copied on each visit, blocks swept in layout order, and a
+ * store scans all the loads of the function for those of its slot. */
+typedef std::unordered_map<LLVMBasicBlockRef, std::set<LLVMValueRef>> setTable;
+
+static void oldGen(LLVMBasicBlockRef bb, setTable *genTable, std::set<LLVMValueRef> *iSet, std::unordered_map<LLVMBasicBlockRef, std::set<LLVMBasicBlockRef>> *sucMap) {
+	std::set<LLVMValueRef> sCheck;
+	(*genTable)[bb] = std::set<LLVMValueRef>();
+	(*sucMap)[bb] = std::set<LLVMBasicBlockRef>();
+	for (LLVMValueRef instruction = LLVMGetFirstInstruction(bb); instruction; instruction = LLVMGetNextInstruction(instruction)) {
+		LLVMOpcode op = LLVMGetInstructionOpcode(instruction);
+		if (op == LLVMStore) {
+			sCheck.insert(LLVMGetOperand(instruction, 1));
+		} else if (op == LLVMLoad) {
+			(*iSet).insert(instruction);
+			if (!sCheck.count(LLVMGetOperand(instruction, 0))) (*genTable)[bb].insert(instruction);
+		} else if (LLVMIsATerminatorInst(instruction)) {
+			for (unsigned i = 0; i < LLVMGetNumSuccessors(instruction); i++)
+				(*sucMap)[bb].insert(LLVMGetSuccessor(instruction, i));
+		}
+	}
+}
+
+static void oldKill(setTable *genTable, setTable *killTable, std::set<LLVMValueRef> *iSet) {
+	for (auto i : (*genTable)) {
+		(*killTable)[i.first] = std::set<LLVMValueRef>();
+		for (LLVMValueRef instruction = LLVMGetFirstInstruction(i.first); instruction; instruction = LLVMGetNextInstruction(instruction)) {
+			if (LLVMGetInstructionOpcode(instruction) != LLVMStore) continue;
+			for (auto k : (*iSet))
+				if (LLVMGetOperand(instruction, 1) == LLVMGetOperand(k, 0)) (*killTable)[i.first].insert(k);
+		}
+	}
+}
+
+// the blocks visited, all of them on every sweep
+static size_t oldLiveness(LLVMValueRef function) {
+	std::unordered_map<LLVMBasicBlockRef, std::set<LLVMBasicBlockRef>> sucMap;
+	setTable genTable, killTable, out;
+	std::set<LLVMValueRef> iSet;
+	for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(function); basicBlock; basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
+		oldGen(basicBlock, &genTable, &iSet, &sucMap);
+		out[basicBlock] = std::set<LLVMValueRef>();
+	}
+	oldKill(&genTable, &killTable, &iSet);
+	setTable in(genTable);
+	size_t visits = 0;
+	bool change = true;
+	while (change) {
+		change = false;
+		for (LLVMBasicBlockRef basicBlock = LLVMGetFirstBasicBlock(function); basicBlock; basicBlock = LLVMGetNextBasicBlock(basicBlock)) {
+			out[basicBlock].clear();
+			for (auto i : sucMap[basicBlock])
+				out[basicBlock].insert(in[i].begin(), in[i].end());
+			std::set<LLVMValueRef> oldin(in[basicBlock]);
+			std::set<LLVMValueRef> temp(out[basicBlock]);
+			for (auto j : killTable[basicBlock])
+				temp.erase(j);
+			in[basicBlock].clear();
+			in[basicBlock].insert(genTable[basicBlock].begin(), genTable[basicBlock].end());
+			in[basicBlock].insert(temp.begin(), temp.end());
+			if (oldin != in[basicBlock]) change = true;
+			visits++;
+		}
+	}
+	return visits;
+}
+
+/* int func(int p) with 32 local slots and a chain of small blocks, each a
+ * few loads and stores of them; one block in four branches back a few
+ * blocks, so that loops nest and overlap */
+static LLVMValueRef generate(LLVMModuleRef mod, unsigned blocks){
+	LLVMTypeRef i32 = LLVMInt32Type();
+	LLVMTypeRef fnType = LLVMFunctionType(i32, &i32, 1, 0);
+	LLVMValueRef fn = LLVMAddFunction(mod, "func", fnType);
+	LLVMBuilderRef b = LLVMCreateBuilder();
+	std::vector<LLVMBasicBlockRef> bbs;
+	for (unsigned k = 0; k <= blocks; k++) bbs.push_back(LLVMAppendBasicBlock(fn, ""));
+	LLVMPositionBuilderAtEnd(b, bbs[0]);
+	LLVMValueRef slots[32];
+	for (int i = 0; i < 32; i++) {
+		slots[i] = LLVMBuildAlloca(b, i32, "");
+		LLVMBuildStore(b, LLVMGetParam(fn, 0), slots[i]);
+	}
+	for (unsigned k = 0; k < blocks; k++) {
+		LLVMPositionBuilderAtEnd(b, bbs[k]);
+		LLVMValueRef x = LLVMBuildLoad2(b, i32, slots[rnd(32)], "");
+		for (int n = 0; n < 3; n++) {
+			LLVMValueRef y = LLVMBuildLoad2(b, i32, slots[rnd(32)], "");
+			x = LLVMBuildAdd(b, x, y, "");
+			LLVMBuildStore(b, x, slots[rnd(32)]);
+		}
+		// nothing branches back to the entry
+		if (k > 1 && rnd(4) == 0) {
+			LLVMValueRef c = LLVMBuildICmp(b, LLVMIntSLT, x, LLVMGetParam(fn, 0), "");
+			LLVMBuildCondBr(b, c, bbs[k - 1 - rnd(k < 9 ? k - 1 : 8)], bbs[k + 1]);
+		} else {
+			LLVMBuildBr(b, bbs[k + 1]);
+		}
+	}
+	LLVMPositionBuilderAtEnd(b, bbs[blocks]);
+	LLVMBuildRet(b, LLVMBuildLoad2(b, i32, slots[0], ""));
+	LLVMDisposeBuilder(b);
+	return fn;
+}
+
+/* builds the function and runs pass over it in a child process, the
+ * time of the pass, the blocks it visited and the child's peak resident
+ * size come back */
+static void measure(const char *name, int pass, unsigned blocks){
+	int fds[2];
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		LLVMModuleRef mod = LLVMModuleCreateWithName("bench");
+		LLVMValueRef fn = generate(mod, blocks);
+		double t0 = now();
+		size_t visits = 0;
+		if (pass == 1) {
+			visits = oldLiveness(fn);
+		} else if (pass > 1) {
+			cfgInfo cfg;
+			slotNumbering num;
+			dataflowSets sets;
+			buildCFG(fn, &cfg);
+			numberSlots(&cfg, &num);
+			if (pass == 2) liveSlots(&cfg, &num, &sets);
+			else reachingStores(&cfg, &num, &sets);
+			visits = sets.visits;
+		}
+		double t = now() - t0;
+		if (write(fds[1], &t, sizeof t) != sizeof t || write(fds[1], &visits, sizeof visits) != sizeof visits) _exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	double t = 0;
+	size_t visits = 0;
+	if (read(fds[0], &t, sizeof t) != sizeof t || read(fds[0], &visits, sizeof visits) != sizeof visits) {
+		fprintf(stderr, "%s failed\n", name);
+		exit(1);
+	}
+	close(fds[0]);
+	int status;
+	struct rusage ru;
+	wait4(pid, &status, 0, &ru);
+	printf("%-10s %8u %10.2f %10.1f %10zu\n", name, blocks, t * 1e3, ru.ru_maxrss / 1024.0, visits);
+}
+
+int main(int argc, char **argv){
+	std::vector<unsigned> sizes;
+	for (int i = 1; i < argc; i++) sizes.push_back(atoi(argv[i]));
+	if (sizes.empty()) sizes = {1000, 10000, 20000};
+
+	printf("%-10s %8s %10s %10s %10s\n", "", "blocks", "ms", "peak MB", "visits");
+	for (unsigned blocks : sizes) {
+		measure("build", 0, blocks);
+		// minutes and gigabytes past that
+		if (blocks <= 10000) measure("sets", 1, blocks);
+		measure("live", 2, blocks);
+		measure("reaching", 3, blocks);
+	}
+	return 0;
+}
@@ -0,0 +1,247 @@
+#include <unordered_map>
+#include <vector>
+#include "gvn.h"
+#include "analysis.h"
+
+/* Global value numbering over the dominator tree.
+ *
+ * Every value gets a number and an instruction is known by its opcode,
+ * predicate, type and the numbers of its operands. The blocks are visited
+ * depth first down the dominator tree with a table from these keys to the
+ * instruction that computed them first. That instruction dominates every
+ * block still to be visited below it, so a later instruction with the same
+ * key is replaced by it. Leaving a block takes its entries out of the
+ * table again.
+ *
+ * A load is keyed by its slot and the slot's memory version. Each store
+ * gives its slot a new version and enters the stored value as what a load
+ * of that version gives, so a load right after a store reuses the value.
+ * A block with more than one predecessor may be reached with other stores
+ * in between: it starts a new epoch and the versions of every slot from
+ * before are no longer used, except for slots stored only once: wherever
+ * their store dominates they hold its value. The slots are allocas that
+ * are never passed anywhere, calls cannot write them.
+ */
+
+typedef struct {
+	int opcode;
+	int predicate;
+	LLVMTypeRef type;
+	unsigned ops[3];
+} exprKey;
+
+static bool operator==(const exprKey &a, const exprKey &b) {
+	return a.opcode == b.opcode && a.predicate == b.predicate && a.type == b.type &&
+		a.ops[0] == b.ops[0] && a.ops[1] == b.ops[1] && a.ops[2] == b.ops[2];
+}
+
+struct exprKeyHash {
+	size_t operator()(const exprKey &k) const {
+		size_t h = std::hash<void*>()(k.type);
+		h = h * 31 + k.opcode;
+		h = h * 31 + k.predicate;
+		for (int j = 0; j < 3; j++) h = h * 1000003 + k.ops[j];
+		return h;
+	}
+};
+
+// the version of a slot: the store that gave it, in the epoch it was made
+// or in none (0) for the only store to the slot
+typedef struct {
+	unsigned epoch;
+	unsigned version;
+} slotVersion;
+
+static std::unordered_map<LLVMValueRef, unsigned> numbers;
+static std::unordered_map<exprKey, LLVMValueRef, exprKeyHash> leaders;
+static std::unordered_map<LLVMValueRef, slotVersion> slots;
+static std::unordered_map<LLVMValueRef, unsigned> storeCount;
+static std::vector<exprKey> inserted;
+static std::vector<std::pair<LLVMValueRef, slotVersion>> slotUndo;
+static unsigned counter;
+static unsigned epoch;
+
+static unsigned numberOf(LLVMValueRef v) {
+	std::unordered_map<LLVMValueRef, unsigned>::iterator it = numbers.find(v);
+	if (it != numbers.end()) return it->second;
+	numbers[v] = ++counter;
+	return counter;
+}
+
+static unsigned versionOf(LLVMValueRef slot) {
+	std::unordered_map<LLVMValueRef, slotVersion>::iterator it = slots.find(slot);
+	if (it != slots.end() && (it->second.epoch == epoch || it->second.epoch == 0)) return it->second.version;
+	return epoch;
+}
+
+static void setVersion(LLVMValueRef slot, unsigned version) {
+	std::unordered_map<LLVMValueRef, slotVersion>::iterator it = slots.find(slot);
+	slotVersion none = {0, 0};
+	slotUndo.push_back(std::make_pair(slot, it == slots.end() ? none : it->second));
+	slotVersion v = {storeCount[slot] == 1 ? 0 : epoch, version};
+	slots[slot] = v;
+}
+
+static bool isCommutative(LLVMOpcode opcode) {
+	switch (opcode) {
+		case LLVMAdd:
+		case LLVMMul:
+		case LLVMAnd:
+		case LLVMOr:
+		case LLVMXor:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static LLVMIntPredicate swapped(LLVMIntPredicate p) {
+	switch (p) {
+		case LLVMIntUGT: return LLVMIntULT;
+		case LLVMIntUGE: return LLVMIntULE;
+		case LLVMIntULT: return LLVMIntUGT;
+		case LLVMIntULE: return LLVMIntUGE;
+		case LLVMIntSGT: return LLVMIntSLT;
+		case LLVMIntSGE: return LLVMIntSLE;
+		case LLVMIntSLT: return LLVMIntSGT;
+		case LLVMIntSLE: return LLVMIntSGE;
+		default: return p;
+	}
+}
+
+/* the key of an instruction without side effects, false for the ones
+ * that are not numbered */
+static bool keyOf(LLVMValueRef i, exprKey *key) {
+	LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+	switch (opcode) {
+		case LLVMAdd: case LLVMSub: case LLVMMul:
+		case LLVMSDiv: case LLVMUDiv: case LLVMSRem: case LLVMURem:
+		case LLVMShl: case LLVMLShr: case LLVMAShr:
+		case LLVMAnd: case LLVMOr: case LLVMXor:
+		case LLVMICmp:
+		case LLVMZExt: case LLVMSExt: case LLVMTrunc:
+		case LLVMSelect:
+			break;
+		default:
+			return false;
+	}
+	key->opcode = opcode;
+	key->predicate = opcode == LLVMICmp ? LLVMGetICmpPredicate(i) : 0;
+	key->type = LLVMTypeOf(i);
+	int n = LLVMGetNumOperands(i);
+	for (int j = 0; j < 3; j++)
+		key->ops[j] = j < n ? numberOf(LLVMGetOperand(i, j)) : 0;
+	// a + b and b + a, a < b and b > a get the same key
+	if ((isCommutative(opcode) || opcode == LLVMICmp) && key->ops[0] > key->ops[1]) {
+		unsigned t = key->ops[0];
+		key->ops[0] = key->ops[1];
+		key->ops[1] = t;
+		if (opcode == LLVMICmp) key->predicate = swapped((LLVMIntPredicate)key->predicate);
+	}
+	return true;
+}
+
+static exprKey loadKey(LLVMTypeRef type, LLVMValueRef slot, unsigned version) {
+	exprKey key = {LLVMLoad, 0, type, {numberOf(slot), version, 0}};
+	return key;
+}
+
+static void enter(const exprKey &key, LLVMValueRef v) {
+	leaders[key] = v;
+	inserted.push_back(key);
+}
+
+// replaces i by the leader of key if there is one, or makes it the leader
+static bool number(LLVMValueRef i, const exprKey &key) {
+	std::unordered_map<exprKey, LLVMValueRef, exprKeyHash>::iterator it = leaders.find(key);
+	if (it == leaders.end()) {
+		enter(key, i);
+		return false;
+	}
+	LLVMReplaceAllUsesWith(i, it->second);
+	LLVMInstructionEraseFromParent(i);
+	return true;
+}
+
+static bool visitBlock(LLVMBasicBlockRef bb, bool join) {
+	bool changed = false;
+	if (join) epoch = ++counter;
+	LLVMValueRef next;
+	for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = next) {
+		next = LLVMGetNextInstruction(i);
+		LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+		exprKey key;
+		if (opcode == LLVMStore) {
+			LLVMValueRef slot = LLVMGetOperand(i, 1);
+			if (!LLVMIsAAllocaInst(slot)) {
+				// not one of ours, it could be any of them
+				epoch = ++counter;
+				continue;
+			}
+			setVersion(slot, ++counter);
+			LLVMValueRef value = LLVMGetOperand(i, 0);
+			enter(loadKey(LLVMTypeOf(value), slot, counter), value);
+		} else if (opcode == LLVMLoad) {
+			LLVMValueRef slot = LLVMGetOperand(i, 0);
+			changed |= number(i, loadKey(LLVMTypeOf(i), slot, versionOf(slot)));
+		} else if (keyOf(i, &key)) {
+			changed |= number(i, key);
+		}
+	}
+	return changed;
+}
+
+typedef struct {
+	unsigned block;
+	size_t child;
+	size_t insertedMark;
+	size_t slotMark;
+	unsigned epoch;
+} domFrame;
+
+bool globalValueNumbering(LLVMValueRef function) {
+	const cfgInfo &cfg = getAnalyses(function, DOMINATORS)->cfg;
+	if (cfg.rpo.empty()) return false;
+
+	numbers.clear();
+	leaders.clear();
+	slots.clear();
+	storeCount.clear();
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb))
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i))
+			if (LLVMIsAStoreInst(i)) storeCount[LLVMGetOperand(i, 1)]++;
+	inserted.clear();
+	slotUndo.clear();
+	counter = 0;
+	epoch = ++counter;
+
+	bool changed = false;
+	// the dominator tree is as deep as the nesting, walk it without recursion
+	std::vector<domFrame> stack;
+	domFrame root = {0, 0, 0, 0, epoch};
+	stack.push_back(root);
+	changed |= visitBlock(cfg.rpo[0], false);
+	while (!stack.empty()) {
+		domFrame &top = stack.back();
+		if (top.child < cfg.domChildren[top.block].size()) {
+			unsigned b = cfg.domChildren[top.block][top.child++];
+			domFrame f = {b, 0, inserted.size(), slotUndo.size(), epoch};
+			stack.push_back(f);
+			changed |= visitBlock(cfg.rpo[b], cfg.preds[b].size() != 1);
+			continue;
+		}
+		// leave the block: what it entered does not hold for its siblings
+		while (inserted.size() > top.insertedMark) {
+			leaders.erase(inserted.back());
+			inserted.pop_back();
+		}
+		while (slotUndo.size() > top.slotMark) {
+			if (slotUndo.back().second.version == 0) slots.erase(slotUndo.back().first);
+			else slots[slotUndo.back().first] = slotUndo.back().second;
+			slotUndo.pop_back();
+		}
+		epoch = top.epoch;
+		stack.pop_back();
+	}
+	return changed;
+}
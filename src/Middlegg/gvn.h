@@ -0,0 +1,11 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+/*
+ * Global value numbering over the dominator tree, see gvn.c. Replaces an
+ * instruction by an equal one that dominates it, and a load by the value
+ * its slot is known to hold.
+ */
+bool globalValueNumbering(LLVMValueRef function);
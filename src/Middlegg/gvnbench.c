@@ -0,0 +1,168 @@
+/*
+Time and peak memory of globalValueNumbering against the string keyed
+common subexpression pass it replaced, on functions of large generated
+blocks. Each pass runs in a process of its own so that the peak resident
+size is its own; "build" only builds the function, for reference.
+Build with `make gvnbench` and run
+	./gvnbench [instructions] [blocks]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "gvn.h"
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned seed = 1;
+
+static unsigned rnd(unsigned n){
+	seed = seed * 1103515245u + 12345u;
+	return (seed >> 8) % n;
+}
+
+/* The pass before gvn.c, as it was: one block at a time, keyed by the
+ * printed instruction, and a store scans the whole table for loads of
+ * its slot. */
+static bool stringCSE(LLVMBasicBlockRef bb) {
+	bool ret = false;
+	std::unordered_map<std::string, LLVMValueRef> m;
+	for (LLVMValueRef instruction = LLVMGetFirstInstruction(bb); instruction; instruction = LLVMGetNextInstruction(instruction)) {
+		if (LLVMGetInstructionOpcode(instruction) == LLVMCall) continue;
+		std::string key = LLVMPrintValueToString(instruction);
+		if (LLVMGetInstructionOpcode(instruction) == LLVMAlloca) {
+			m[key] = instruction;
+		} else {
+			size_t pos = key.find('=');
+			if (pos != std::string::npos) {
+				key = key.substr(pos + 1);
+			}
+			if (m.count(key)) {
+				LLVMReplaceAllUsesWith(instruction, m.at(key));
+				ret = true;
+			} else {
+				if (LLVMGetInstructionOpcode(instruction) == LLVMStore) {
+					std::unordered_map<std::string, LLVMValueRef>::iterator it = m.begin();
+					while (it != m.end()) {
+						if (LLVMGetInstructionOpcode(it->second) == LLVMLoad) {
+							int size = LLVMGetNumOperands(it->second);
+							LLVMValueRef cmp = LLVMGetOperand(it->second, size-1);
+							if (cmp == LLVMGetOperand(instruction, 1)) {
+								m.erase(it->first);
+								break;
+							}
+						}
+						it++;
+					}
+				}
+				m[key] = instruction;
+			}
+		}
+	}
+	return ret;
+}
+
+/* int func(int p) with 32 local slots and a chain of blocks, each a long
+ * run of loads, stores and arithmetic over a few recent values, so that
+ * the same expressions come up again and again */
+static LLVMValueRef generate(LLVMModuleRef mod, unsigned instructions, unsigned blocks){
+	LLVMTypeRef i32 = LLVMInt32Type();
+	LLVMTypeRef fnType = LLVMFunctionType(i32, &i32, 1, 0);
+	LLVMValueRef fn = LLVMAddFunction(mod, "func", fnType);
+	LLVMBuilderRef b = LLVMCreateBuilder();
+	LLVMBasicBlockRef bb = LLVMAppendBasicBlock(fn, "");
+	LLVMPositionBuilderAtEnd(b, bb);
+	LLVMValueRef slots[32];
+	for (int i = 0; i < 32; i++) {
+		slots[i] = LLVMBuildAlloca(b, i32, "");
+		LLVMBuildStore(b, LLVMGetParam(fn, 0), slots[i]);
+	}
+	static const LLVMOpcode ops[] = {LLVMAdd, LLVMSub, LLVMMul, LLVMAnd, LLVMXor};
+	std::vector<LLVMValueRef> recent;
+	for (unsigned k = 0; k < blocks; k++) {
+		recent.clear();
+		for (int i = 0; i < 4; i++) recent.push_back(LLVMBuildLoad2(b, i32, slots[rnd(32)], ""));
+		for (unsigned n = 0; n < instructions / blocks; n++) {
+			LLVMValueRef x = recent[recent.size() - 1 - rnd(4)];
+			LLVMValueRef y = recent[recent.size() - 1 - rnd(4)];
+			switch (rnd(8)) {
+				case 0:
+					LLVMBuildStore(b, x, slots[rnd(32)]);
+					break;
+				case 1:
+				case 2:
+					recent.push_back(LLVMBuildLoad2(b, i32, slots[rnd(32)], ""));
+					break;
+				default:
+					recent.push_back(LLVMBuildBinOp(b, ops[rnd(5)], x, y, ""));
+					break;
+			}
+		}
+		LLVMBuildStore(b, recent.back(), slots[0]);
+		LLVMBasicBlockRef next = LLVMAppendBasicBlock(fn, "");
+		LLVMBuildBr(b, next);
+		LLVMPositionBuilderAtEnd(b, next);
+	}
+	LLVMBuildRet(b, LLVMBuildLoad2(b, i32, slots[0], ""));
+	LLVMDisposeBuilder(b);
+	return fn;
+}
+
+/* builds the function and runs pass over it in a child process, the
+ * time of the pass and the child's peak resident size come back */
+static void measure(const char *name, int pass, unsigned instructions, unsigned blocks){
+	int fds[2];
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		LLVMModuleRef mod = LLVMModuleCreateWithName("bench");
+		LLVMValueRef fn = generate(mod, instructions, blocks);
+		double t0 = now();
+		if (pass == 1) {
+			for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(fn); bb; bb = LLVMGetNextBasicBlock(bb))
+				stringCSE(bb);
+		} else if (pass == 2) {
+			globalValueNumbering(fn);
+		}
+		double t = now() - t0;
+		if (write(fds[1], &t, sizeof t) != sizeof t) _exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	double t = 0;
+	if (read(fds[0], &t, sizeof t) != sizeof t) {
+		fprintf(stderr, "%s failed\n", name);
+		exit(1);
+	}
+	close(fds[0]);
+	int status;
+	struct rusage ru;
+	wait4(pid, &status, 0, &ru);
+	printf("%-8s %10.2f %10.1f\n", name, t * 1e3, ru.ru_maxrss / 1024.0);
+}
+
+int main(int argc, char **argv){
+	unsigned instructions = argc > 1 ? atoi(argv[1]) : 10000;
+	unsigned blocks = argc > 2 ? atoi(argv[2]) : 4;
+	if (blocks == 0) blocks = 1;
+
+	printf("%u instructions in %u blocks\n", instructions, blocks);
+	printf("%-8s %10s %10s\n", "", "ms", "peak MB");
+	measure("build", 0, instructions, blocks);
+	measure("cse", 1, instructions, blocks);
+	measure("gvn", 2, instructions, blocks);
+	return 0;
+}
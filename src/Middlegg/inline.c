@@ -0,0 +1,299 @@
+#include <unordered_map>
+#include <vector>
+#include "inline.h"
+#include "analysis.h"
+
+/* Inlining of calls between the functions of the program.
+ *
+ * A function can only call the functions defined before it and itself
+ * (see semantic.c). The optimizer goes through the module in order and
+ * inlines into each function before optimizing it, so every callee is
+ * done by the time its callers are: what gets copied into a caller has
+ * its own small calls expanded and is optimized already, and the cost
+ * model sees its final size. Calls of a function to itself are left
+ * alone.
+ *
+ * The cost model counts what the callee's body adds to the caller
+ * against what the call costs in the generated code:
+ *  - every instruction of the callee costs 1, a call 4, an alloca, a phi
+ *    and the ret nothing (a slot, a join, a branch);
+ *  - inlining saves CALL_OVERHEAD, the caller saving %ecx and %edx,
+ *    pushing the argument and calling, and the callee's prologue and
+ *    epilogue;
+ *  - a constant argument saves CONST_ARG_BONUS more for each use of the
+ *    parameter, the optimizer folds it in after inlining.
+ * A call is inlined when cost - savings is at most the threshold, and
+ * only while the caller stays below MAX_CALLER_SIZE instructions.
+ */
+
+#define CALL_OVERHEAD 12
+#define CONST_ARG_BONUS 2
+#define MAX_CALLER_SIZE 2000
+
+static int threshold = INLINE_DEFAULT_THRESHOLD;
+static bool enabled = true;
+static size_t inlined = 0;
+
+void setInlineThreshold(int t) {
+	threshold = t;
+}
+
+void setInlineEnabled(bool on) {
+	enabled = on;
+}
+
+static int instructionCost(LLVMValueRef i) {
+	switch (LLVMGetInstructionOpcode(i)) {
+		case LLVMAlloca:
+		case LLVMPHI:
+		case LLVMRet:
+			return 0;
+		case LLVMCall:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+static int functionCost(LLVMValueRef func) {
+	int cost = 0;
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb))
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i))
+			cost += instructionCost(i);
+	return cost;
+}
+
+static int functionSize(LLVMValueRef func) {
+	int size = 0;
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb))
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i))
+			size++;
+	return size;
+}
+
+/* uses of the parameter, through the slot the builder stores it to */
+static int paramUses(LLVMValueRef param) {
+	int uses = 0;
+	for (LLVMUseRef u = LLVMGetFirstUse(param); u; u = LLVMGetNextUse(u)) {
+		LLVMValueRef user = LLVMGetUser(u);
+		if (LLVMIsAStoreInst(user) && LLVMGetOperand(user, 0) == param) {
+			for (LLVMUseRef s = LLVMGetFirstUse(LLVMGetOperand(user, 1)); s; s = LLVMGetNextUse(s))
+				if (LLVMIsALoadInst(LLVMGetUser(s))) uses++;
+		} else {
+			uses++;
+		}
+	}
+	return uses;
+}
+
+/* The slot the builder stores the parameter to, when nothing else is
+ * stored there: the copies of its loads can use the argument itself.
+ */
+static LLVMValueRef paramSlot(LLVMValueRef callee) {
+	if (LLVMCountParams(callee) == 0) return NULL;
+	LLVMUseRef use = LLVMGetFirstUse(LLVMGetParam(callee, 0));
+	if (use == NULL || LLVMGetNextUse(use) != NULL) return NULL;
+	LLVMValueRef store = LLVMGetUser(use);
+	if (!LLVMIsAStoreInst(store) || LLVMGetOperand(store, 0) != LLVMGetParam(callee, 0)) return NULL;
+	// stored first thing, before any load of it
+	if (LLVMGetInstructionParent(store) != LLVMGetEntryBasicBlock(callee)) return NULL;
+	LLVMValueRef slot = LLVMGetOperand(store, 1);
+	if (!LLVMIsAAllocaInst(slot)) return NULL;
+	for (LLVMUseRef u = LLVMGetFirstUse(slot); u; u = LLVMGetNextUse(u)) {
+		LLVMValueRef user = LLVMGetUser(u);
+		if (user != store && !LLVMIsALoadInst(user)) return NULL;
+	}
+	return slot;
+}
+
+static int inlineCost(LLVMValueRef call, LLVMValueRef callee) {
+	int savings = CALL_OVERHEAD;
+	if (LLVMGetNumArgOperands(call) > 0 && LLVMIsAConstantInt(LLVMGetArgOperand(call, 0)))
+		savings += CONST_ARG_BONUS * paramUses(LLVMGetParam(callee, 0));
+	return functionCost(callee) - savings;
+}
+
+/* The phis of bb that have from as an incoming block get to instead.
+ * The C API cannot change an incoming block in place, so such a phi is
+ * built again.
+ */
+static void retargetPhis(LLVMBuilderRef b, LLVMBasicBlockRef bb, LLVMBasicBlockRef from, LLVMBasicBlockRef to) {
+	LLVMValueRef next;
+	for (LLVMValueRef phi = LLVMGetFirstInstruction(bb); phi && LLVMIsAPHINode(phi); phi = next) {
+		next = LLVMGetNextInstruction(phi);
+		unsigned n = LLVMCountIncoming(phi);
+		bool found = false;
+		for (unsigned k = 0; k < n; k++)
+			found |= LLVMGetIncomingBlock(phi, k) == from;
+		if (!found) continue;
+
+		LLVMPositionBuilderBefore(b, phi);
+		LLVMValueRef repl = LLVMBuildPhi(b, LLVMTypeOf(phi), "");
+		for (unsigned k = 0; k < n; k++) {
+			LLVMValueRef v = LLVMGetIncomingValue(phi, k);
+			LLVMBasicBlockRef in = LLVMGetIncomingBlock(phi, k);
+			if (in == from) in = to;
+			LLVMAddIncoming(repl, &v, &in, 1);
+		}
+		LLVMReplaceAllUsesWith(phi, repl);
+		LLVMInstructionEraseFromParent(phi);
+	}
+}
+
+/* Replaces call by a copy of the callee's body. The instructions after
+ * the call are taken out, the callee's entry block is copied at the end of
+ * the call's block and its other blocks after it. With a single ret the
+ * taken out instructions replace it; with several each ret becomes a
+ * branch to a new block holding them, where a phi joins the returned
+ * values. The callee's allocas go to the caller's entry block.
+ */
+static void inlineCall(LLVMValueRef call, LLVMValueRef callee) {
+	LLVMBasicBlockRef callBB = LLVMGetInstructionParent(call);
+	LLVMValueRef caller = LLVMGetBasicBlockParent(callBB);
+	LLVMBasicBlockRef entryBB = LLVMGetEntryBasicBlock(caller);
+	LLVMBuilderRef b = LLVMCreateBuilder();
+
+	std::vector<LLVMValueRef> tail;
+	LLVMValueRef next;
+	for (LLVMValueRef i = LLVMGetNextInstruction(call); i; i = next) {
+		next = LLVMGetNextInstruction(i);
+		LLVMInstructionRemoveFromParent(i);
+		tail.push_back(i);
+	}
+
+	// callee value -> its copy; blocks are in here as values too
+	std::unordered_map<LLVMValueRef, LLVMValueRef> vmap;
+	for (unsigned k = 0; k < LLVMCountParams(callee); k++)
+		vmap[LLVMGetParam(callee, k)] = LLVMGetArgOperand(call, k);
+	LLVMValueRef argSlot = paramSlot(callee);
+
+	// nothing branches to an entry block, so it can go on in callBB
+	LLVMBasicBlockRef last = callBB;
+	for (LLVMBasicBlockRef cb = LLVMGetFirstBasicBlock(callee); cb; cb = LLVMGetNextBasicBlock(cb)) {
+		LLVMBasicBlockRef nb = callBB;
+		if (cb != LLVMGetFirstBasicBlock(callee)) {
+			nb = LLVMAppendBasicBlock(caller, LLVMGetBasicBlockName(cb));
+			LLVMMoveBasicBlockAfter(nb, last);
+			last = nb;
+		}
+		vmap[LLVMBasicBlockAsValue(cb)] = LLVMBasicBlockAsValue(nb);
+	}
+
+	int numReturns = 0;
+	for (LLVMBasicBlockRef cb = LLVMGetFirstBasicBlock(callee); cb; cb = LLVMGetNextBasicBlock(cb))
+		if (LLVMGetInstructionOpcode(LLVMGetBasicBlockTerminator(cb)) == LLVMRet) numReturns++;
+	LLVMBasicBlockRef afterBB = NULL;
+	if (numReturns != 1) {
+		afterBB = LLVMAppendBasicBlock(caller, "afterCallBB");
+		LLVMMoveBasicBlockAfter(afterBB, last);
+	}
+
+	/* copy the instructions first and map their operands once every
+	 * copy exists, an operand may be defined further down */
+	std::vector<LLVMValueRef> copies;
+	std::vector<LLVMValueRef> phis;
+	std::vector<std::pair<LLVMBasicBlockRef, LLVMValueRef>> returns;
+	for (LLVMBasicBlockRef cb = LLVMGetFirstBasicBlock(callee); cb; cb = LLVMGetNextBasicBlock(cb)) {
+		LLVMBasicBlockRef nb = LLVMValueAsBasicBlock(vmap[LLVMBasicBlockAsValue(cb)]);
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cb); i; i = LLVMGetNextInstruction(i)) {
+			LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+			if (argSlot != NULL && i == argSlot) continue;
+			if (argSlot != NULL && opcode == LLVMStore && LLVMGetOperand(i, 1) == argSlot) continue;
+			if (argSlot != NULL && opcode == LLVMLoad && LLVMGetOperand(i, 0) == argSlot) {
+				vmap[i] = LLVMGetArgOperand(call, 0);
+				continue;
+			}
+			if (opcode == LLVMAlloca) {
+				LLVMPositionBuilderBefore(b, LLVMGetFirstInstruction(entryBB));
+				vmap[i] = LLVMBuildAlloca(b, LLVMGetAllocatedType(i), LLVMGetValueName(i));
+				continue;
+			}
+			LLVMPositionBuilderAtEnd(b, nb);
+			if (opcode == LLVMPHI) {
+				vmap[i] = LLVMBuildPhi(b, LLVMTypeOf(i), "");
+				phis.push_back(i);
+			} else if (opcode == LLVMRet) {
+				if (afterBB != NULL) LLVMBuildBr(b, afterBB);
+				returns.push_back(std::make_pair(nb, LLVMGetNumOperands(i) > 0 ? LLVMGetOperand(i, 0) : NULL));
+			} else {
+				LLVMValueRef copy = LLVMInstructionClone(i);
+				LLVMInsertIntoBuilder(b, copy);
+				vmap[i] = copy;
+				copies.push_back(copy);
+			}
+		}
+	}
+
+	auto mapped = [&](LLVMValueRef v) {
+		std::unordered_map<LLVMValueRef, LLVMValueRef>::iterator it = vmap.find(v);
+		return it == vmap.end() ? v : it->second;
+	};
+	for (LLVMValueRef copy : copies) {
+		int numOps = LLVMGetNumOperands(copy);
+		for (int j = 0; j < numOps; j++)
+			LLVMSetOperand(copy, j, mapped(LLVMGetOperand(copy, j)));
+	}
+	for (LLVMValueRef phi : phis) {
+		for (unsigned k = 0; k < LLVMCountIncoming(phi); k++) {
+			LLVMValueRef v = mapped(LLVMGetIncomingValue(phi, k));
+			LLVMBasicBlockRef in = LLVMValueAsBasicBlock(mapped(LLVMBasicBlockAsValue(LLVMGetIncomingBlock(phi, k))));
+			LLVMAddIncoming(vmap[phi], &v, &in, 1);
+		}
+	}
+
+	LLVMValueRef result = NULL;
+	if (afterBB == NULL) {
+		afterBB = returns[0].first;
+		result = mapped(returns[0].second);
+	} else if (!returns.empty()) {
+		LLVMPositionBuilderAtEnd(b, afterBB);
+		result = LLVMBuildPhi(b, LLVMTypeOf(call), "");
+		for (size_t k = 0; k < returns.size(); k++) {
+			LLVMValueRef v = mapped(returns[k].second);
+			LLVMAddIncoming(result, &v, &returns[k].first, 1);
+		}
+	}
+
+	LLVMPositionBuilderAtEnd(b, afterBB);
+	for (LLVMValueRef i : tail)
+		LLVMInsertIntoBuilder(b, i);
+	LLVMValueRef term = LLVMGetBasicBlockTerminator(afterBB);
+	for (unsigned k = 0; afterBB != callBB && term != NULL && k < LLVMGetNumSuccessors(term); k++)
+		retargetPhis(b, LLVMGetSuccessor(term, k), callBB, afterBB);
+
+	if (LLVMGetTypeKind(LLVMTypeOf(call)) != LLVMVoidTypeKind)
+		LLVMReplaceAllUsesWith(call, result != NULL ? result : LLVMGetUndef(LLVMTypeOf(call)));
+	LLVMInstructionEraseFromParent(call);
+	LLVMDisposeBuilder(b);
+}
+
+void inlineCalls(LLVMValueRef func) {
+	if (!enabled || LLVMCountBasicBlocks(func) == 0) return;
+
+	std::vector<LLVMValueRef> calls;
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(func); bb; bb = LLVMGetNextBasicBlock(bb)) {
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i)) {
+			if (!LLVMIsACallInst(i)) continue;
+			LLVMValueRef callee = LLVMGetCalledValue(i);
+			// read and print have no body to copy
+			if (callee == func || LLVMCountBasicBlocks(callee) == 0) continue;
+			calls.push_back(i);
+		}
+	}
+
+	int size = functionSize(func);
+	for (LLVMValueRef call : calls) {
+		LLVMValueRef callee = LLVMGetCalledValue(call);
+		int calleeSize = functionSize(callee);
+		if (inlineCost(call, callee) > threshold || size + calleeSize > MAX_CALLER_SIZE) continue;
+		inlineCall(call, callee);
+		size += calleeSize;
+		inlined++;
+		// the call's block is split and the callee's blocks come in
+		preserveAnalyses(func, NO_ANALYSES);
+	}
+}
+
+size_t inlinedCalls() {
+	return inlined;
+}
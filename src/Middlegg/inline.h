@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+/*
+ * Inlining of calls between the functions of the module, see inline.c.
+ * A call is inlined when the callee's cost, less what inlining saves,
+ * stays within the threshold.
+ */
+#define INLINE_DEFAULT_THRESHOLD 25
+
+void setInlineThreshold(int threshold);
+void setInlineEnabled(bool on);
+
+/* inlines the calls in func that pass the cost model, its callees are
+   expected to be optimized already */
+void inlineCalls(LLVMValueRef func);
+
+/* calls inlined so far, for -stats */
+size_t inlinedCalls();
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "passes.h"
+#include "opt.h"
+
+// the inliner counts what it does, a function it inlined into changed
+static bool inlinePass(LLVMValueRef function) {
+	size_t before = inlinedCalls();
+	inlineCalls(function);
+	return inlinedCalls() != before;
+}
+
+const passInfo passRegistry[] = {
+	{"inline", inlinePass, NULL, "inline small calls (inline.c)"},
+	{"cse", globalValueNumbering, NULL, "common subexpressions and loads, by value numbering (gvn.c)"},
+	{"dce", aggressiveDCE, NULL, "dead code and loops (adce.c)"},
+	{"fold", combineInstructions, NULL, "constants, identities and constant branches (combine.c)"},
+	{"constprop", sparseCondConstProp, NULL, "constants through slots and branches (sccp.c)"},
+	{"dse", livevarAnalysis, NULL, "stores no load reads, from liveness (livevar.md)"},
+	{"local-dse", NULL, localStoreElim, "stores overwritten later in their block"},
+	{NULL, NULL, NULL, NULL},
+};
+
+/* -O1 goes over the function once, -O2 repeats until nothing changes and
+ * removes the dead stores left at the end.
+ */
+static const char *const levels[] = {
+	"",
+	"inline,cse,fold,constprop,dce",
+	"inline,fixpoint(cse,dce,fold,constprop),dse",
+};
+
+static std::vector<pipelineStep> pipeline;
+static bool pipelineSet = false;
+
+static const passInfo *findPass(const char *name, size_t length) {
+	for (const passInfo *p = passRegistry; p->name != NULL; p++)
+		if (strlen(p->name) == length && strncmp(p->name, name, length) == 0) return p;
+	return NULL;
+}
+
+// list := step (',' step)*, step := name | fixpoint[:N](list)
+static bool parseList(const char **text, std::vector<pipelineStep> *steps) {
+	while (true) {
+		const char *start = *text;
+		while (**text != '\0' && **text != ',' && **text != '(' && **text != ')') (*text)++;
+		size_t length = *text - start;
+		pipelineStep step;
+		step.pass = NULL;
+		step.cap = FIXPOINT_CAP;
+		if (**text == '(') {
+			if (length < 8 || strncmp(start, "fixpoint", 8) != 0 || (length > 8 && start[8] != ':')) {
+				fprintf(stderr, "--passes: only fixpoint can take a list, not %.*s\n", (int) length, start);
+				return false;
+			}
+			if (length > 8) {
+				char *end;
+				long cap = strtol(start + 9, &end, 10);
+				if (end != *text || cap <= 0) {
+					fprintf(stderr, "--passes: bad fixpoint cap %.*s\n", (int) length, start);
+					return false;
+				}
+				step.cap = cap;
+			}
+			(*text)++;
+			if (!parseList(text, &step.body)) return false;
+			if (**text != ')') {
+				fprintf(stderr, "--passes: missing ) after fixpoint\n");
+				return false;
+			}
+			(*text)++;
+		} else {
+			step.pass = findPass(start, length);
+			if (step.pass == NULL) {
+				fprintf(stderr, "--passes: unknown pass '%.*s', the passes are:\n", (int) length, start);
+				for (const passInfo *p = passRegistry; p->name != NULL; p++)
+					fprintf(stderr, "  %-10s %s\n", p->name, p->what);
+				return false;
+			}
+		}
+		steps->push_back(step);
+		if (**text != ',') return true;
+		(*text)++;
+	}
+}
+
+bool parsePipeline(const char *text, std::vector<pipelineStep> *steps) {
+	steps->clear();
+	// an empty pipeline runs nothing
+	if (*text == '\0') return true;
+	if (!parseList(&text, steps)) return false;
+	if (*text != '\0') {
+		fprintf(stderr, "--passes: unexpected %s\n", text);
+		return false;
+	}
+	return true;
+}
+
+static bool runPass(const passInfo *pass, LLVMValueRef function) {
+	if (pass->onFunction != NULL) return pass->onFunction(function);
+	bool changed = false;
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb))
+		changed |= pass->onBlock(bb);
+	return changed;
+}
+
+typedef struct {
+	std::string name;
+	double seconds;
+	size_t before, after;
+	unsigned rounds;
+} functionStats;
+
+static bool recording = false;
+// by place in passRegistry, by fixpoint round from the first and by function
+static std::vector<passStats> perPass;
+static std::vector<passStats> perRound;
+static std::vector<functionStats> perFunction;
+// the entry of the function being recorded, NULL for none
+static functionStats *current = NULL;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef std::unordered_map<LLVMBasicBlockRef, std::vector<LLVMValueRef>> blockSnapshot;
+
+static size_t snapshot(LLVMValueRef function, blockSnapshot *blocks) {
+	size_t n = 0;
+	blocks->clear();
+	for (LLVMBasicBlockRef bb = LLVMGetFirstBasicBlock(function); bb; bb = LLVMGetNextBasicBlock(bb)) {
+		std::vector<LLVMValueRef> &list = (*blocks)[bb];
+		for (LLVMValueRef i = LLVMGetFirstInstruction(bb); i; i = LLVMGetNextInstruction(i)) list.push_back(i);
+		n += list.size();
+	}
+	return n;
+}
+
+/* Instructions are told apart by address: one that is only there after
+ * the pass was added, one that is only there before was removed. A block
+ * was touched if it came or went or its list of instructions is not the
+ * same. An instruction built where a removed one was counts as neither.
+ */
+static void compareSnapshots(const blockSnapshot &before, const blockSnapshot &after, passStats *d) {
+	std::unordered_set<LLVMValueRef> old;
+	for (const auto &b : before) old.insert(b.second.begin(), b.second.end());
+	size_t kept = 0;
+	for (const auto &b : after) {
+		for (LLVMValueRef i : b.second) {
+			if (old.count(i)) kept++;
+			else d->added++;
+		}
+		blockSnapshot::const_iterator it = before.find(b.first);
+		if (it == before.end() || it->second != b.second) d->blocks++;
+	}
+	d->removed = old.size() - kept;
+	for (const auto &b : before)
+		if (after.find(b.first) == after.end()) d->blocks++;
+}
+
+static void addStats(passStats *to, const passStats &d) {
+	to->runs += d.runs;
+	to->changed += d.changed;
+	to->seconds += d.seconds;
+	to->added += d.added;
+	to->removed += d.removed;
+	to->blocks += d.blocks;
+	to->visits += d.visits;
+}
+
+// only the pass itself is timed, not the snapshots around it
+static bool recordPass(const passInfo *pass, LLVMValueRef function, unsigned round) {
+	blockSnapshot before, after;
+	snapshot(function, &before);
+	dataflowStats start = dataflowCounts();
+	double begin = now();
+	bool changed = runPass(pass, function);
+	passStats d = {1, changed ? 1u : 0u, now() - begin, 0, 0, 0, 0};
+	dataflowStats end = dataflowCounts();
+	d.visits = end.liveVisits - start.liveVisits;
+	snapshot(function, &after);
+	compareSnapshots(before, after, &d);
+
+	addStats(&perPass[pass - passRegistry], d);
+	if (round > 0) {
+		if (perRound.size() < round) perRound.resize(round, passStats());
+		addStats(&perRound[round - 1], d);
+	}
+	current->seconds += d.seconds;
+	if (round > current->rounds) current->rounds = round;
+	return changed;
+}
+
+// round is that of the innermost fixpoint the steps are in, 0 for none
+static bool runSteps(const std::vector<pipelineStep> &steps, LLVMValueRef function, unsigned round) {
+	bool changed = false;
+	for (const pipelineStep &step : steps) {
+		if (step.pass == NULL) {
+			for (unsigned r = 0; r < step.cap && runSteps(step.body, function, r + 1); r++)
+				changed = true;
+		} else if (current != NULL) {
+			changed |= recordPass(step.pass, function, round);
+		} else {
+			changed |= runPass(step.pass, function);
+		}
+	}
+	return changed;
+}
+
+bool runPipeline(const std::vector<pipelineStep> &steps, LLVMValueRef function) {
+	return runSteps(steps, function, 0);
+}
+
+void setOptLevel(int level) {
+	if (level < 1) level = 1;
+	if (level > 2) level = 2;
+	parsePipeline(levels[level], &pipeline);
+	pipelineSet = true;
+}
+
+bool setPassPipeline(const char *text) {
+	pipelineSet = parsePipeline(text, &pipeline);
+	return pipelineSet;
+}
+
+bool optimizeFunction(LLVMValueRef function) {
+	if (!pipelineSet) setOptLevel(2);
+	// the declarations of read and print have no body to optimize
+	if (LLVMCountBasicBlocks(function) == 0) return false;
+	if (!recording) return runSteps(pipeline, function, 0);
+
+	blockSnapshot blocks;
+	functionStats f = {LLVMGetValueName(function), 0, snapshot(function, &blocks), 0, 0};
+	perFunction.push_back(f);
+	current = &perFunction.back();
+	bool changed = runSteps(pipeline, function, 0);
+	current->after = snapshot(function, &blocks);
+	current = NULL;
+	return changed;
+}
+
+void recordPasses(bool on) {
+	recording = on;
+	size_t n = 0;
+	while (passRegistry[n].name != NULL) n++;
+	perPass.assign(n, passStats());
+	perRound.clear();
+	perFunction.clear();
+}
+
+static double totalSeconds() {
+	double total = 0;
+	for (const passStats &p : perPass) total += p.seconds;
+	return total;
+}
+
+void printPassReport(FILE *out) {
+	double total = totalSeconds();
+	fprintf(out, "%-10s %6s %7s %10s %6s %8s %8s %7s %8s\n", "pass", "runs", "changed", "time ms", "%", "added", "removed", "blocks", "visits");
+	passStats sum = passStats();
+	for (size_t k = 0; k < perPass.size(); k++) {
+		const passStats &p = perPass[k];
+		if (p.runs == 0) continue;
+		fprintf(out, "%-10s %6zu %7zu %10.3f %6.1f %8zu %8zu %7zu %8zu\n", passRegistry[k].name, p.runs, p.changed,
+			p.seconds * 1e3, total > 0 ? 100 * p.seconds / total : 0.0, p.added, p.removed, p.blocks, p.visits);
+		addStats(&sum, p);
+	}
+	fprintf(out, "%-10s %6zu %7zu %10.3f %6.1f %8zu %8zu %7zu %8zu\n", "total", sum.runs, sum.changed,
+		sum.seconds * 1e3, total > 0 ? 100.0 : 0.0, sum.added, sum.removed, sum.blocks, sum.visits);
+	if (perRound.empty()) return;
+
+	fprintf(out, "%-10s %6s %7s %10s %6s %8s %8s %7s %8s\n", "round", "runs", "changed", "time ms", "%", "added", "removed", "blocks", "visits");
+	for (size_t r = 0; r < perRound.size(); r++) {
+		const passStats &p = perRound[r];
+		fprintf(out, "%-10zu %6zu %7zu %10.3f %6.1f %8zu %8zu %7zu %8zu\n", r + 1, p.runs, p.changed,
+			p.seconds * 1e3, total > 0 ? 100 * p.seconds / total : 0.0, p.added, p.removed, p.blocks, p.visits);
+	}
+}
+
+static void printStatsJSON(FILE *out, const passStats &p) {
+	fprintf(out, "\"runs\": %zu, \"changed\": %zu, \"seconds\": %.9f, \"added\": %zu, \"removed\": %zu, \"blocks\": %zu, \"dataflow_visits\": %zu",
+		p.runs, p.changed, p.seconds, p.added, p.removed, p.blocks, p.visits);
+}
+
+// the names are those of miniC functions, nothing in them needs escaping
+bool writePassReport(const char *filename) {
+	FILE *out = fopen(filename, "w");
+	if (out == NULL) return false;
+	fprintf(out, "{\n  \"seconds\": %.9f,\n  \"passes\": [", totalSeconds());
+	const char *sep = "\n";
+	for (size_t k = 0; k < perPass.size(); k++) {
+		if (perPass[k].runs == 0) continue;
+		fprintf(out, "%s    {\"name\": \"%s\", ", sep, passRegistry[k].name);
+		printStatsJSON(out, perPass[k]);
+		fputs("}", out);
+		sep = ",\n";
+	}
+	fputs("\n  ],\n  \"rounds\": [", out);
+	sep = "\n";
+	for (size_t r = 0; r < perRound.size(); r++) {
+		fprintf(out, "%s    {\"round\": %zu, ", sep, r + 1);
+		printStatsJSON(out, perRound[r]);
+		fputs("}", out);
+		sep = ",\n";
+	}
+	fputs("\n  ],\n  \"functions\": [", out);
+	sep = "\n";
+	for (const functionStats &f : perFunction) {
+		fprintf(out, "%s    {\"name\": \"%s\", \"seconds\": %.9f, \"rounds\": %u, \"instructions_before\": %zu, \"instructions_after\": %zu}",
+			sep, f.name.c_str(), f.seconds, f.rounds, f.before, f.after);
+		sep = ",\n";
+	}
+	fputs("\n  ]\n}\n", out);
+	return fclose(out) == 0;
+}
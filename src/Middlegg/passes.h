@@ -0,0 +1,67 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+#include <vector>
+
+/*
+ * The passes by name and the pipelines made of them, see passes.c. A
+ * pipeline is a comma separated list of pass names run one after the
+ * other on each function; fixpoint(...) runs the list in it again while
+ * any of its passes changes something, FIXPOINT_CAP rounds at most, or
+ * N with fixpoint:N(...).
+ */
+#define FIXPOINT_CAP 16
+
+typedef bool (*functionPass)(LLVMValueRef function);
+// a block pass may change its block's instructions but not its edges
+typedef bool (*blockPass)(LLVMBasicBlockRef bb);
+
+typedef struct {
+	const char *name;
+	// one of the two, the other NULL
+	functionPass onFunction;
+	blockPass onBlock;
+	const char *what;
+} passInfo;
+
+// a pass, or with pass NULL a fixpoint of the steps in body
+typedef struct pipelineStep {
+	const passInfo *pass;
+	std::vector<pipelineStep> body;
+	unsigned cap;
+} pipelineStep;
+
+// the registered passes, the last with a NULL name
+extern const passInfo passRegistry[];
+
+// false, after saying why on stderr, for a pipeline that is not well formed
+bool parsePipeline(const char *text, std::vector<pipelineStep> *steps);
+// whether any pass changed function
+bool runPipeline(const std::vector<pipelineStep> &steps, LLVMValueRef function);
+
+/* What optimizeFunction runs: the pipeline of -O1 or -O2, the default,
+   or the one given with --passes */
+void setOptLevel(int level);
+bool setPassPipeline(const char *text);
+bool optimizeFunction(LLVMValueRef function);
+
+/* What each pass did, recorded from recordPasses(true) on, for -stats and
+   -ftime-report: wall time, instructions added and removed, blocks whose
+   instructions changed and blocks the dataflow solver visited */
+typedef struct {
+	size_t runs, changed;
+	double seconds;
+	size_t added, removed, blocks, visits;
+} passStats;
+
+void recordPasses(bool on);
+// per pass, then per fixpoint round
+void printPassReport(FILE *out);
+// the same and per function as JSON, false if filename cannot be written
+bool writePassReport(const char *filename);
+
+#endif
@@ -0,0 +1,270 @@
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "sccp.h"
+#include "analysis.h"
+#include "combine.h"
+
+/* Sparse conditional constant propagation, after Wegman and Zadeck.
+ *
+ * Every value starts out unknown (NULL), may become one constant, and ends
+ * up as many values (bottom) once it is seen to take two. Only blocks that
+ * an edge already found executable leads to are looked at: a branch on a
+ * constant makes only the edge it takes executable, so whatever is on the
+ * other side never lowers the values it flows into. Values go down the
+ * lattice only, so each changes at most twice and the users of a value
+ * are visited again, from the SSA worklist, only when it changes.
+ *
+ * The builder keeps the locals in allocas, so the slots are followed
+ * through memory as well: each block has the value of every slot at its
+ * end, its start is the meet of that over the executable edges into it,
+ * and the block is gone through again, from the block worklist, when that
+ * changes or a store in it stores something else. The slots start out as
+ * bottom in the entry block: a slot read before it is written holds
+ * whatever was on the stack.
+ *
+ * At the end a value or load that is a constant is replaced by it, a
+ * branch with one executable edge jumps there, and the blocks no longer
+ * reached are deleted.
+ */
+
+static char bottomTag;
+static LLVMValueRef const bottom = (LLVMValueRef) &bottomTag;
+
+static const cfgInfo *cfg;
+static std::unordered_map<LLVMValueRef, LLVMValueRef> values;
+static std::unordered_map<LLVMValueRef, unsigned> slotIndex;
+static std::vector<std::vector<LLVMValueRef>> exitState;
+static std::vector<bool> seen;
+static std::unordered_set<unsigned long long> edges;
+static std::vector<unsigned> blockWork;
+static std::vector<bool> blockQueued;
+static std::vector<LLVMValueRef> ssaWork;
+
+static LLVMValueRef meet(LLVMValueRef a, LLVMValueRef b) {
+	if (a == NULL) return b;
+	if (b == NULL || a == b) return a;
+	return bottom;
+}
+
+static LLVMValueRef valueOf(LLVMValueRef v) {
+	if (LLVMIsAConstantInt(v)) return v;
+	if (!LLVMIsAInstruction(v)) return bottom;
+	std::unordered_map<LLVMValueRef, LLVMValueRef>::iterator it = values.find(v);
+	return it == values.end() ? NULL : it->second;
+}
+
+static void lower(LLVMValueRef i, LLVMValueRef v) {
+	LLVMValueRef old = valueOf(i);
+	LLVMValueRef now = meet(old, v);
+	if (now == old) return;
+	values[i] = now;
+	for (LLVMUseRef u = LLVMGetFirstUse(i); u; u = LLVMGetNextUse(u))
+		ssaWork.push_back(LLVMGetUser(u));
+}
+
+static void pushBlock(unsigned b) {
+	if (blockQueued[b]) return;
+	blockQueued[b] = true;
+	blockWork.push_back(b);
+}
+
+static bool executable(unsigned from, unsigned to) {
+	return edges.count((unsigned long long) from * cfg->rpo.size() + to) != 0;
+}
+
+static void markEdge(unsigned from, LLVMBasicBlockRef to) {
+	unsigned t = cfg->order.at(to);
+	// a new way in: the phis and the slots at the start change
+	if (edges.insert((unsigned long long) from * cfg->rpo.size() + t).second) pushBlock(t);
+}
+
+// everything but the loads and stores of slots, which the block scan does
+static void evaluate(LLVMValueRef i, unsigned b) {
+	LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+	switch (opcode) {
+		case LLVMPHI: {
+			LLVMValueRef v = NULL;
+			for (unsigned k = 0; k < LLVMCountIncoming(i); k++) {
+				LLVMBasicBlockRef in = LLVMGetIncomingBlock(i, k);
+				if (cfg->order.count(in) && executable(cfg->order.at(in), b))
+					v = meet(v, valueOf(LLVMGetIncomingValue(i, k)));
+			}
+			if (v != NULL) lower(i, v);
+			break;
+		}
+		case LLVMAdd: case LLVMSub: case LLVMMul:
+		case LLVMSDiv: case LLVMUDiv: case LLVMSRem: case LLVMURem:
+		case LLVMShl: case LLVMLShr: case LLVMAShr:
+		case LLVMAnd: case LLVMOr: case LLVMXor:
+		case LLVMICmp: {
+			LLVMValueRef a = valueOf(LLVMGetOperand(i, 0));
+			LLVMValueRef c = valueOf(LLVMGetOperand(i, 1));
+			if (a == bottom || c == bottom) {
+				lower(i, bottom);
+			} else if (a != NULL && c != NULL) {
+				LLVMValueRef r = opcode == LLVMICmp ? foldCompareConstants(LLVMGetICmpPredicate(i), a, c) : foldBinaryConstants(opcode, a, c);
+				lower(i, r != NULL ? r : bottom);
+			}
+			break;
+		}
+		case LLVMZExt: case LLVMSExt: case LLVMTrunc: {
+			LLVMValueRef a = valueOf(LLVMGetOperand(i, 0));
+			if (a == bottom) lower(i, bottom);
+			else if (a != NULL) lower(i, LLVMConstInt(LLVMTypeOf(i), opcode == LLVMSExt ? LLVMConstIntGetSExtValue(a) : LLVMConstIntGetZExtValue(a), 0));
+			break;
+		}
+		case LLVMSelect: {
+			LLVMValueRef c = valueOf(LLVMGetOperand(i, 0));
+			if (c == bottom) lower(i, meet(valueOf(LLVMGetOperand(i, 1)), valueOf(LLVMGetOperand(i, 2))));
+			else if (c != NULL) lower(i, valueOf(LLVMGetOperand(i, LLVMConstIntGetZExtValue(c) ? 1 : 2)));
+			break;
+		}
+		case LLVMBr: {
+			if (!LLVMIsConditional(i)) {
+				markEdge(b, LLVMGetSuccessor(i, 0));
+				break;
+			}
+			LLVMValueRef c = valueOf(LLVMGetCondition(i));
+			if (c == bottom) {
+				markEdge(b, LLVMGetSuccessor(i, 0));
+				markEdge(b, LLVMGetSuccessor(i, 1));
+			} else if (c != NULL) {
+				markEdge(b, LLVMGetSuccessor(i, LLVMConstIntGetZExtValue(c) ? 0 : 1));
+			}
+			break;
+		}
+		default:
+			if (LLVMIsATerminatorInst(i)) {
+				for (unsigned k = 0; k < LLVMGetNumSuccessors(i); k++)
+					markEdge(b, LLVMGetSuccessor(i, k));
+			} else if (LLVMGetTypeKind(LLVMTypeOf(i)) != LLVMVoidTypeKind) {
+				// calls, loads of memory that is not a slot
+				lower(i, bottom);
+			}
+			break;
+	}
+}
+
+static void scanBlock(unsigned b) {
+	seen[b] = true;
+	std::vector<LLVMValueRef> state(slotIndex.size(), b == 0 ? bottom : NULL);
+	for (unsigned p : cfg->preds[b]) {
+		if (!executable(p, b)) continue;
+		for (unsigned s = 0; s < state.size(); s++)
+			state[s] = meet(state[s], exitState[p][s]);
+	}
+	for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i)) {
+		LLVMOpcode opcode = LLVMGetInstructionOpcode(i);
+		if (opcode == LLVMStore || opcode == LLVMLoad) {
+			std::unordered_map<LLVMValueRef, unsigned>::iterator it = slotIndex.find(LLVMGetOperand(i, opcode == LLVMStore ? 1 : 0));
+			if (it != slotIndex.end()) {
+				if (opcode == LLVMStore) state[it->second] = valueOf(LLVMGetOperand(i, 0));
+				else lower(i, state[it->second]);
+				continue;
+			}
+		}
+		evaluate(i, b);
+	}
+	if (exitState[b] != state) {
+		exitState[b] = state;
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(cfg->rpo[b]);
+		for (unsigned k = 0; term != NULL && k < LLVMGetNumSuccessors(term); k++) {
+			unsigned s = cfg->order.at(LLVMGetSuccessor(term, k));
+			if (executable(b, s)) pushBlock(s);
+		}
+	}
+}
+
+static void solve() {
+	pushBlock(0);
+	while (!blockWork.empty() || !ssaWork.empty()) {
+		while (!ssaWork.empty()) {
+			LLVMValueRef i = ssaWork.back();
+			ssaWork.pop_back();
+			std::unordered_map<LLVMBasicBlockRef, unsigned>::const_iterator it = cfg->order.find(LLVMGetInstructionParent(i));
+			if (it == cfg->order.end() || !seen[it->second]) continue;
+			// a store or load of a slot changes what the block leaves
+			if (LLVMIsAStoreInst(i) || LLVMIsALoadInst(i)) pushBlock(it->second);
+			else evaluate(i, it->second);
+		}
+		if (!blockWork.empty()) {
+			unsigned b = blockWork.back();
+			blockWork.pop_back();
+			blockQueued[b] = false;
+			scanBlock(b);
+		}
+	}
+}
+
+bool sparseCondConstProp(LLVMValueRef function) {
+	cfg = &getAnalyses(function, CFG_ANALYSIS)->cfg;
+	unsigned n = cfg->rpo.size();
+	if (n == 0) return false;
+
+	values.clear();
+	slotIndex.clear();
+	edges.clear();
+	blockWork.clear();
+	ssaWork.clear();
+	// inlined callees bring their allocas along into other blocks
+	for (unsigned b = 0; b < n; b++)
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = LLVMGetNextInstruction(i))
+			if (isLocalSlot(i)) {
+			unsigned k = slotIndex.size();
+			slotIndex[i] = k;
+		}
+	exitState.assign(n, std::vector<LLVMValueRef>());
+	seen.assign(n, false);
+	blockQueued.assign(n, false);
+	solve();
+
+	// a branch that never got a known condition would leave the blocks
+	// behind it looked at too little; it cannot happen, but do nothing then
+	for (unsigned b = 0; b < n; b++) {
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(cfg->rpo[b]);
+		if (seen[b] && LLVMIsABranchInst(term) && LLVMIsConditional(term) &&
+			!executable(b, cfg->order.at(LLVMGetSuccessor(term, 0))) && !executable(b, cfg->order.at(LLVMGetSuccessor(term, 1))))
+			return false;
+	}
+
+	bool changed = false, branched = false;
+	LLVMBuilderRef builder = LLVMCreateBuilderInContext(LLVMGetModuleContext(LLVMGetGlobalParent(function)));
+	for (unsigned b = 0; b < n; b++) {
+		if (!seen[b]) continue;
+		LLVMValueRef next;
+		for (LLVMValueRef i = LLVMGetFirstInstruction(cfg->rpo[b]); i; i = next) {
+			next = LLVMGetNextInstruction(i);
+			LLVMValueRef v = valueOf(i);
+			if (v == NULL || v == bottom || LLVMIsACallInst(i)) continue;
+			LLVMReplaceAllUsesWith(i, v);
+			LLVMInstructionEraseFromParent(i);
+			changed = true;
+		}
+		LLVMValueRef term = LLVMGetBasicBlockTerminator(cfg->rpo[b]);
+		if (!LLVMIsABranchInst(term) || !LLVMIsConditional(term)) continue;
+		LLVMBasicBlockRef taken = LLVMGetSuccessor(term, 0), other = LLVMGetSuccessor(term, 1);
+		if (taken == other) continue;
+		if (!executable(b, cfg->order.at(taken))) {
+			taken = other;
+			other = LLVMGetSuccessor(term, 0);
+		} else if (executable(b, cfg->order.at(other))) {
+			continue;
+		}
+		LLVMValueRef phi = LLVMGetFirstInstruction(other);
+		while (phi && LLVMIsAPHINode(phi)) {
+			next = LLVMGetNextInstruction(phi);
+			phiWithout(phi, cfg->rpo[b]);
+			LLVMInstructionEraseFromParent(phi);
+			phi = next;
+		}
+		LLVMPositionBuilderBefore(builder, term);
+		LLVMBuildBr(builder, taken);
+		LLVMInstructionEraseFromParent(term);
+		branched = true;
+	}
+	LLVMDisposeBuilder(builder);
+	branched |= removeUnreachable(function);
+	if (branched) preserveAnalyses(function, NO_ANALYSES);
+	return changed || branched;
+}
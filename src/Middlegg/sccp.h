@@ -0,0 +1,11 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Types.h>
+
+/*
+ * Sparse conditional constant propagation, see sccp.c. Replaces values
+ * and loads known to be constant, and removes the branches and blocks
+ * that constant conditions never take.
+ */
+bool sparseCondConstProp(LLVMValueRef function);
@@ -0,0 +1,26 @@
+extern void print(int);
+extern int read();
+
+int func(int n){
+	int a;
+	int b;
+	int c;
+	a = read();
+	b = 0;
+	c = 0;
+	if (a < n) {
+		b = a + 1;
+	}
+	c = n * 3;
+	if (a < n) {
+		c = c - b;
+	}
+	while (b < n) {
+		b = b + 2;
+		if (b < n) {
+			c = c + 1;
+		}
+	}
+	print(b);
+	return c;
+}
@@ -0,0 +1,16 @@
+extern void print(int);
+extern int read();
+
+int func(int n){
+	int a;
+	int b;
+	int c;
+	a = read();
+	b = (a + 3) - n;
+	print(n * 2);
+	b = a * a;
+	c = a + a;
+	a = n - 1;
+	print(c - a);
+	return b - a;
+}
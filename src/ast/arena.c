@@ -0,0 +1,132 @@
+#include"arena.h"
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdint.h>
+#include<string.h>
+
+struct arena_Chunk {
+		arenaChunk* next; // previously filled chunk
+		size_t size; // usable bytes in data
+		size_t used;
+		char data[];
+	};
+
+/* local helper: get a fresh chunk that can hold at least size bytes */
+static arenaChunk* newChunk(astArena* arena, size_t size){
+	if (size < arena->chunk_size)
+		size = arena->chunk_size;
+
+	arenaChunk* chunk = (arenaChunk*) malloc(sizeof(arenaChunk) + size);
+	if (chunk == NULL){
+		fprintf(stderr, "arena: out of memory\n");
+		exit(1);
+	}
+	chunk->size = size;
+	chunk->used = 0;
+
+	arena->bytes_reserved += sizeof(arenaChunk) + size;
+	arena->num_chunks++;
+	return chunk;
+}
+
+void arenaInit(astArena* arena, size_t chunk_size){
+	arena->head = NULL;
+	arena->chunk_size = chunk_size;
+	arena->num_allocs = 0;
+	arena->bytes_used = 0;
+	arena->bytes_reserved = 0;
+	arena->num_chunks = 0;
+	arena->peak_used = 0;
+}
+
+void* arenaAlloc(astArena* arena, size_t size, size_t align){
+	arenaChunk* chunk = arena->head;
+	size_t start = 0;
+
+	if (chunk != NULL){
+		uintptr_t p = (uintptr_t)(chunk->data + chunk->used);
+		start = chunk->used + ((align - p % align) % align);
+	}
+
+	if (chunk == NULL || start + size > chunk->size){
+		/* an oversized request gets a chunk of its own so the current
+		chunk can keep serving small requests */
+		arenaChunk* fresh = newChunk(arena, size + align);
+		if (chunk != NULL && size + align > arena->chunk_size){
+			fresh->next = chunk->next;
+			chunk->next = fresh;
+		} else {
+			fresh->next = chunk;
+			arena->head = fresh;
+		}
+		chunk = fresh;
+		uintptr_t p = (uintptr_t)chunk->data;
+		start = (align - p % align) % align;
+	}
+
+	arena->bytes_used += start - chunk->used + size;
+	if (arena->bytes_used > arena->peak_used)
+		arena->peak_used = arena->bytes_used;
+	arena->num_allocs++;
+	chunk->used = start + size;
+	return chunk->data + start;
+}
+
+char* arenaStrdup(astArena* arena, const char* s){
+	size_t len = strlen(s) + 1;
+	char* ret = (char*) arenaAlloc(arena, len, 1);
+	memcpy(ret, s, len);
+	return ret;
+}
+
+astArenaMark arenaMark(astArena* arena){
+	astArenaMark mark;
+	mark.head = arena->head;
+	mark.next = arena->head != NULL ? arena->head->next : NULL;
+	mark.used = arena->head != NULL ? arena->head->used : 0;
+	mark.bytes_used = arena->bytes_used;
+	return mark;
+}
+
+/* local helper: give a chunk back to malloc */
+static void freeChunk(astArena* arena, arenaChunk* chunk){
+	arena->bytes_reserved -= sizeof(arenaChunk) + chunk->size;
+	arena->num_chunks--;
+	free(chunk);
+}
+
+void arenaRewind(astArena* arena, astArenaMark mark){
+	/* chunks started after the mark are in front of the marked head,
+	oversized ones may also sit right behind it */
+	while (arena->head != mark.head){
+		arenaChunk* next = arena->head->next;
+		freeChunk(arena, arena->head);
+		arena->head = next;
+	}
+	if (mark.head != NULL){
+		arenaChunk* chunk = mark.head->next;
+		while (chunk != mark.next){
+			arenaChunk* next = chunk->next;
+			freeChunk(arena, chunk);
+			chunk = next;
+		}
+		mark.head->next = mark.next;
+		mark.head->used = mark.used;
+	}
+	arena->bytes_used = mark.bytes_used;
+}
+
+void arenaRelease(astArena* arena){
+	arenaChunk* chunk = arena->head;
+	while (chunk != NULL){
+		arenaChunk* next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = NULL;
+}
+
+void printArenaStats(astArena* arena, FILE* out){
+	fprintf(out, "AST arena: %zu allocations, %zu bytes used (peak %zu), %zu bytes reserved in %zu chunks\n",
+			arena->num_allocs, arena->bytes_used, arena->peak_used, arena->bytes_reserved, arena->num_chunks);
+}
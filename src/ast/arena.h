@@ -0,0 +1,78 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdio>
+
+/*
+A bump allocator owned by one compilation. Memory is carved out of large
+chunks and is never returned piece by piece; arenaRelease frees all the
+chunks in one go, which releases everything allocated from the arena.
+*/
+
+struct arena_Chunk;
+typedef struct arena_Chunk arenaChunk;
+
+typedef struct {
+		arenaChunk* head; // chunk we are currently allocating from
+		size_t chunk_size; // size of a regular chunk
+		size_t num_allocs; // number of allocations served
+		size_t bytes_used; // bytes handed out, including alignment padding
+		size_t bytes_reserved; // bytes obtained from malloc for chunks
+		size_t num_chunks;
+		size_t peak_used; // largest bytes_used seen, rewinding lowers bytes_used
+	} astArena;
+
+/*
+A point in an arena to rewind to: arenaRewind releases everything
+allocated after arenaMark returned it, chunks included. Marks must be
+rewound to in the reverse order they were taken, like a stack.
+*/
+typedef struct {
+		arenaChunk* head;
+		arenaChunk* next; // head->next when the mark was taken
+		size_t used; // head->used when the mark was taken
+		size_t bytes_used;
+	} astArenaMark;
+
+void arenaInit(astArena* arena, size_t chunk_size=64*1024);
+void* arenaAlloc(astArena* arena, size_t size, size_t align=alignof(std::max_align_t));
+char* arenaStrdup(astArena* arena, const char* s);
+astArenaMark arenaMark(astArena* arena);
+void arenaRewind(astArena* arena, astArenaMark mark);
+void arenaRelease(astArena* arena);
+void printArenaStats(astArena* arena, FILE* out);
+
+/*
+Allocator for standard containers that lives in an arena. A NULL arena
+falls back to the global heap, so the same container type can be used
+with and without an arena. deallocate is a no-op for arena memory.
+*/
+template <class T>
+struct arena_allocator {
+		typedef T value_type;
+		astArena* arena;
+
+		arena_allocator(astArena* a=NULL) : arena(a) {}
+		template <class U>
+		arena_allocator(const arena_allocator<U>& other) : arena(other.arena) {}
+
+		T* allocate(size_t n) {
+			if (arena != NULL)
+				return (T*) arenaAlloc(arena, n * sizeof(T), alignof(T));
+			return (T*) ::operator new(n * sizeof(T));
+		}
+
+		void deallocate(T* p, size_t n) {
+			if (arena == NULL)
+				::operator delete(p);
+		}
+	};
+
+template <class T, class U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.arena == b.arena; }
+
+template <class T, class U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) { return a.arena != b.arena; }
+
+#endif
@@ -3,6 +3,122 @@
 #include<stdlib.h>
 #include<assert.h>
 #include<string.h>
+#include<stdint.h>
+#include<unordered_map>
+
+static astArena *ast_arena = NULL;
+
+/* allocation helpers, see ast.h */
+void setAstArena(astArena *arena){
+	ast_arena = arena;
+}
+
+astArena* getAstArena(){
+	return ast_arena;
+}
+
+void* astAlloc(size_t size){
+	if (ast_arena == NULL)
+		return calloc(1, size);
+
+	void *ret = arenaAlloc(ast_arena, size);
+	memset(ret, 0, size);
+	return ret;
+}
+
+void astFree(void *ptr){
+	// arena memory is only released with the arena itself
+	if (ast_arena == NULL)
+		free(ptr);
+}
+
+astList* createList(){
+	if (ast_arena == NULL)
+		return new astList();
+
+	void *mem = arenaAlloc(ast_arena, sizeof(astList), alignof(astList));
+	return new (mem) astList(arena_allocator<astNode*>(ast_arena));
+}
+
+/*
+Hash-consing. While it is on, side-effect free expressions (constants,
+variables and operators over those) are looked up in a table before a
+node is made, so equal expressions share one node and the tree becomes
+a DAG. A variable is keyed by its symbol and the symbol's version. The
+version is bumped whenever the variable may stand for a different value
+or a different declaration from then on: on an assignment to it, on a
+declaration of it and when a block declaring it ends. Expressions read
+before and after such a point therefore stay apart. Reads of read() are
+never shared and neither is anything above them.
+*/
+typedef struct {
+	int type;
+	int op;
+	uintptr_t a;
+	uintptr_t b;
+} consKey;
+
+struct consKeyHash {
+	size_t operator()(const consKey &k) const {
+		size_t h = (size_t) k.type * 31 + (size_t) k.op;
+		h = h * 1000003u ^ (size_t) k.a;
+		h = h * 1000003u ^ (size_t) k.b;
+		return h ^ (h >> 17);
+	}
+};
+
+struct consKeyEq {
+	bool operator()(const consKey &x, const consKey &y) const {
+		return x.type == y.type && x.op == y.op && x.a == y.a && x.b == y.b;
+	}
+};
+
+static bool hash_cons = false;
+static unordered_map<consKey, astNode*, consKeyHash, consKeyEq> cons_table;
+static vector<unsigned> sym_versions; // symId -> version
+static size_t cons_hits = 0;
+
+void setHashCons(bool on){
+	// shared nodes have several parents, only an arena frees them safely
+	assert(!on || ast_arena != NULL);
+	hash_cons = on;
+	cons_table.clear();
+	sym_versions.clear();
+	cons_hits = 0;
+}
+
+size_t hashConsHits(){
+	return cons_hits;
+}
+
+static unsigned symVersion(symId sym){
+	if ((size_t) sym >= sym_versions.size())
+		return 0;
+	return sym_versions[sym];
+}
+
+static void bumpVersion(symId sym){
+	if (!hash_cons || sym < 0)
+		return;
+	if ((size_t) sym >= sym_versions.size())
+		sym_versions.resize(sym + 1, 0);
+	sym_versions[sym]++;
+}
+
+/* local helper: the shared node for key, NULL if there is none yet */
+static astNode* consLookup(const consKey &key){
+	unordered_map<consKey, astNode*, consKeyHash, consKeyEq>::iterator it = cons_table.find(key);
+	if (it == cons_table.end())
+		return NULL;
+	cons_hits++;
+	return it->second;
+}
+
+static astNode* consInsert(const consKey &key, astNode *node){
+	node->shared = true;
+	cons_table[key] = node;
+	return node;
+}
 
 /* local helper functions */
 char * get_indent_str(int n){
@@ -15,7 +131,7 @@ char * get_indent_str(int n){
 /* create and free functions for ast_prog type astNode */
 astNode* createProg(astNode *ext1, astNode	*ext2, astNode	*func){
 	astNode	*node;
-	node = (astNode *)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_prog;
 
 	node->prog.ext1 = ext1;
@@ -27,185 +143,199 @@ astNode* createProg(astNode *ext1, astNode	*ext2, astNode	*func){
 
 void freeProg(astNode *node){
 	assert(node != NULL && node->type == ast_prog);
-	
-	freeExtern(node->prog.ext1);
-	freeExtern(node->prog.ext2);
-	freeFunc(node->prog.func);
-	
-	free(node);
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for ast_func type astNode */
 astNode* createFunc(const char *name, astNode *param, astNode* body){
+	return createFunc(internName(name), param, body);
+}
+
+astNode* createFunc(symId name, astNode *param, astNode* body){
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_func;
 
-	node->func.name = (char *) calloc(1, sizeof(char) * (strlen(name)+1));
-	strcpy(node->func.name, name);
+	node->func.sym = name;
+	node->func.name = symName(name);
 
 	node->func.param = param;
 	node->func.body = body;
+	node->func.locals = NULL;
+	node->func.next = NULL;
 
 	return node;
 }
 
 void freeFunc(astNode *node){
 	assert(node != NULL && node->type == ast_func);
-	
-	free(node->func.name);
-	if (node->func.param != NULL)
-		freeVar(node->func.param);
-
-	freeBlock(node->func.body);
-	
-	free(node);
-	
-	return;
+	freeNode(node);
 }
 
 /*create and free functionns for ast_extern*/
 
 astNode* createExtern(const char *name){
+	return createExtern(internName(name));
+}
+
+astNode* createExtern(symId name){
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_extern;
 	
-	node->ext.name = (char *) calloc(1, sizeof(char) * (strlen(name)+1));
-	strcpy(node->ext.name, name);
+	node->ext.sym = name;
+	node->ext.name = symName(name);
 
 	return(node);
 }
 
 void freeExtern(astNode *node){
 	assert(node != NULL && node->type == ast_extern);
-	
-	free(node->ext.name);
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for ast_var*/
 
 astNode* createVar(const char *name){
+	return createVar(internName(name));
+}
+
+astNode* createVar(symId name){
+	consKey key = {ast_var, 0, (uintptr_t) name, symVersion(name)};
+	if (hash_cons){
+		astNode *shared = consLookup(key);
+		if (shared != NULL)
+			return shared;
+	}
+
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_var;
 	
-	node->var.name = (char *) calloc(1, sizeof(char) * (strlen(name)+1));
-	strcpy(node->var.name, name);
+	node->var.sym = name;
+	node->var.name = symName(name);
 	
-	return(node);
+	return hash_cons ? consInsert(key, node) : node;
 }
 
 void freeVar(astNode *node){
 	assert(node != NULL && node->type == ast_var);
-	
-	free(node->var.name);
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for ast_cnst type of node*/
 astNode* createCnst(int value){
+	consKey key = {ast_cnst, 0, (uintptr_t) (unsigned) value, 0};
+	if (hash_cons){
+		astNode *shared = consLookup(key);
+		if (shared != NULL)
+			return shared;
+	}
+
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_cnst;
 
 	node->cnst.value = value;
-	return(node);
+	return hash_cons ? consInsert(key, node) : node;
 }
 
 void freeCnst(astNode *node){
-	assert(node != NULL);
-	free(node);
-
-	return;
+	assert(node != NULL && node->type == ast_cnst);
+	freeNode(node);
 }
 
 /*create and free functions for ast_rexpr type of node*/
 astNode* createRExpr(astNode *lhs, astNode *rhs, rop_type op){
+	consKey key = {ast_rexpr, op, (uintptr_t) lhs, (uintptr_t) rhs};
+	bool share = hash_cons && lhs->shared && rhs->shared;
+	if (share){
+		astNode *shared = consLookup(key);
+		if (shared != NULL)
+			return shared;
+	}
+
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_rexpr;
 	
 	node->rexpr.lhs = lhs;
 	node->rexpr.rhs = rhs;
 	node->rexpr.op = op;
 
-	return(node);
+	return share ? consInsert(key, node) : node;
 }
 
 void freeRExpr(astNode *node){
 	assert(node != NULL && node->type == ast_rexpr);
-	
-	// We call freeNode as we don't know the type of nodes for lhs and rhs
-	freeNode(node->rexpr.lhs);
-	freeNode(node->rexpr.rhs);
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
 
 /*create and free functions for ast_bexpr type of node*/
 astNode* createBExpr(astNode *lhs, astNode *rhs, op_type op){
+	consKey key = {ast_bexpr, op, (uintptr_t) lhs, (uintptr_t) rhs};
+	bool share = hash_cons && lhs->shared && rhs->shared;
+	if (share){
+		astNode *shared = consLookup(key);
+		if (shared != NULL)
+			return shared;
+	}
+
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_bexpr;
 	
 	node->bexpr.lhs = lhs;
 	node->bexpr.rhs = rhs;
 	node->bexpr.op = op;
 
-	return(node);
+	return share ? consInsert(key, node) : node;
 }
 
 void freeBExpr(astNode *node){
 	assert(node != NULL && node->type == ast_bexpr);
-	
-	//We call freeNode as we don't know the type of nodes for rhs and lhs
-	freeNode(node->bexpr.lhs);
-	freeNode(node->bexpr.rhs);
-
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
 /* create and free functions for ast_uexpr type of node */
 astNode* createUExpr(astNode *expr, op_type op){
+	consKey key = {ast_uexpr, op, (uintptr_t) expr, 0};
+	bool share = hash_cons && expr->shared;
+	if (share){
+		astNode *shared = consLookup(key);
+		if (shared != NULL)
+			return shared;
+	}
+
 	astNode *node;
-	node = (astNode*)calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_uexpr;
 	
 	node->uexpr.expr = expr;
 	node->uexpr.op = op;
 	
-	return(node);
+	return share ? consInsert(key, node) : node;
 }
 
 void freeUExpr(astNode *node){
 	assert(node != NULL && node->type == ast_uexpr);
-	
-	freeNode(node->uexpr.expr);
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
 /* create and free functions for a statement of type ast_call */
 astNode* createCall(const char *name, astNode *param){
+	return createCall(internName(name), param);
+}
+
+astNode* createCall(symId name, astNode *param){
 	astNode *node;
-	node = (astNode*) calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_call;
 	
-	node->stmt.call.name = (char *) calloc(strlen(name) + 1, sizeof(char));
-	strcpy(node->stmt.call.name, name);
+	node->stmt.call.sym = name;
+	node->stmt.call.name = symName(name);
 	
 	node->stmt.call.param = param;
 
@@ -215,19 +345,13 @@ astNode* createCall(const char *name, astNode *param){
 void freeCall(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_call);
-	
-	free(node->stmt.call.name);
-	if (node->stmt.call.param != NULL)
-		freeNode(node->stmt.call.param);
-
-	free(node);
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for a stmt of type ast_ret*/
 astNode* createRet(astNode	*expr){
 	astNode *node;
-	node = (astNode*) calloc(1, sizeof(astNode));
+	node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_ret;
 	
@@ -235,23 +359,26 @@ astNode* createRet(astNode	*expr){
 	return(node);
 }
 
-void freeRet(astNode *node){	
+void freeRet(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_ret);
-
-	freeNode(node->stmt.ret.expr);
-	free(node);
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for a stmt of type ast_block*/
-astNode* createBlock(vector<astNode*> *stmt_list){
-	vector<astNode*> slist;
-	astNode* node = (astNode *)calloc(1, sizeof(astNode));
+astNode* createBlock(astList *stmt_list){
+	astNode* node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_block;
 	
 	node->stmt.block.stmt_list = stmt_list;
+
+	// the names declared here refer to something else again from now on
+	if (hash_cons){
+		for (astNode *n : *stmt_list)
+			if (n->type == ast_stmt && n->stmt.type == ast_decl)
+				bumpVersion(n->stmt.decl.sym);
+	}
 	
 	return(node);
 }
@@ -259,23 +386,12 @@ astNode* createBlock(vector<astNode*> *stmt_list){
 void freeBlock(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_block);
-
-	vector<astNode *> slist = *(node->stmt.block.stmt_list);
-	vector<astNode*>::iterator it = slist.begin();
-
-	while (it != slist.end()){
-		freeNode(*it);
-		it++;	
-	}
-	
-	delete(node->stmt.block.stmt_list);
-	free(node);
-	return;
+	freeNode(node);
 }
 
 /* create and free functions for stmt of type while*/
 astNode* createWhile(astNode *cond, astNode *body){
-	astNode* node = (astNode *)calloc(1, sizeof(astNode));
+	astNode* node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_while;
 	
@@ -288,17 +404,12 @@ astNode* createWhile(astNode *cond, astNode *body){
 void freeWhile(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_while);
-
-	freeNode(node->stmt.whilen.cond);
-	freeNode(node->stmt.whilen.body);
-	
-	free(node);
-	return;
+	freeNode(node);
 }
 
 /*create and free functions for stmt of type if*/
 astNode* createIf(astNode *cond, astNode *ifbody, astNode *elsebody){
-	astNode* node = (astNode *)calloc(1, sizeof(astNode));
+	astNode* node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_if;
 
@@ -312,25 +423,22 @@ astNode* createIf(astNode *cond, astNode *ifbody, astNode *elsebody){
 void freeIf(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_if);
-	
-	freeNode(node->stmt.ifn.cond);
-	freeNode(node->stmt.ifn.if_body);
-	if (node->stmt.ifn.else_body != NULL)
-		freeNode(node->stmt.ifn.else_body);
-
-	free(node);	
-
-	return;
+	freeNode(node);
 }
 
 /* create and free functions of stmt type ast_decl */
 astNode* createDecl(const char *name){
-	astNode* node = (astNode *)calloc(1, sizeof(astNode));
+	return createDecl(internName(name));
+}
+
+astNode* createDecl(symId name){
+	astNode* node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_decl;
 
-	node->stmt.decl.name = (char *)calloc(strlen(name)+1, sizeof(char));
-	strcpy(node->stmt.decl.name, name);
+	node->stmt.decl.sym = name;
+	node->stmt.decl.name = symName(name);
+	bumpVersion(name);
 
 	return(node);
 }
@@ -338,19 +446,18 @@ astNode* createDecl(const char *name){
 void freeDecl(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_decl);
-	
-	free(node->stmt.decl.name);
-	free(node);
+	freeNode(node);
 }
 
 /* create and free functions of stmt type ast_assign */
 astNode* createAsgn(astNode *lhs, astNode *rhs){
-	astNode* node = (astNode *)calloc(1, sizeof(astNode));
+	astNode* node = (astNode *)astAlloc(sizeof(astNode));
 	node->type = ast_stmt;
 	node->stmt.type = ast_asgn;
 
 	node->stmt.asgn.lhs = lhs;
 	node->stmt.asgn.rhs = rhs;
+	bumpVersion(lhs->var.sym);
 
 	return(node);
 }
@@ -358,121 +465,153 @@ astNode* createAsgn(astNode *lhs, astNode *rhs){
 void freeAsgn(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
 	assert(node->stmt.type == ast_asgn);
-	
-	freeVar(node->stmt.asgn.lhs);
-	freeNode(node->stmt.asgn.rhs);
-	free(node);
-
-	return;
+	freeNode(node);
 }
 
-/* free function for releasing all the memory assigned to a node based
-on the type. This function is called by other free* functions when
-the type of a child node is not obvious from the context */
-
-void freeNode(astNode *node){
-	assert(node != NULL);
-
+/* local helper: releases node itself and pushes its children on
+pending, so that freeNode never recurses however deep the tree is */
+static void releaseNode(astNode *node, vector<astNode*> &pending){
 	switch(node->type){
-		case ast_prog:{
-						freeProg(node);
-						break;
-					  }
-		case ast_func:{
-						freeFunc(node);
-						break;
-					  }
-		case ast_stmt:{
-						freeStmt(node);
-						break;
-					  }
-		case ast_extern:{
-						freeExtern(node);
-						break;
-					  }
-		case ast_var: {	
-						freeVar(node);
-						break;
-					  }
-		case ast_cnst: {
-						 freeCnst(node);
-						 break;
-					  }
-		case ast_rexpr: {
-						freeRExpr(node);
-						break;
-					  }
-		case ast_bexpr: {
-						freeBExpr(node);
-						break;
-					  }
-		case ast_uexpr: {
-						freeUExpr(node);
-						break;
-					  }
+		case ast_prog:
+			if (node->prog.ext1 != NULL)
+				pending.push_back(node->prog.ext1);
+			if (node->prog.ext2 != NULL)
+				pending.push_back(node->prog.ext2);
+			pending.push_back(node->prog.func);
+			break;
+		case ast_func:
+			if (node->func.param != NULL)
+				pending.push_back(node->func.param);
+			pending.push_back(node->func.body);
+			if (node->func.next != NULL)
+				pending.push_back(node->func.next);
+			// the locals list only refers to declarations inside the body
+			if (node->func.locals != NULL && getAstArena() == NULL)
+				delete(node->func.locals);
+			break;
+		case ast_rexpr:
+			pending.push_back(node->rexpr.lhs);
+			pending.push_back(node->rexpr.rhs);
+			break;
+		case ast_bexpr:
+			pending.push_back(node->bexpr.lhs);
+			pending.push_back(node->bexpr.rhs);
+			break;
+		case ast_uexpr:
+			pending.push_back(node->uexpr.expr);
+			break;
+		case ast_extern:
+		case ast_var:
+		case ast_cnst:
+			break;
+		case ast_stmt: {
+			astStmt *stmt = &(node->stmt);
+			switch(stmt->type){
+				case ast_call:
+					if (stmt->call.param != NULL)
+						pending.push_back(stmt->call.param);
+					break;
+				case ast_ret:
+					pending.push_back(stmt->ret.expr);
+					break;
+				case ast_block:
+					pending.insert(pending.end(), stmt->block.stmt_list->begin(), stmt->block.stmt_list->end());
+					if (getAstArena() == NULL)
+						delete(stmt->block.stmt_list);
+					break;
+				case ast_while:
+					pending.push_back(stmt->whilen.cond);
+					pending.push_back(stmt->whilen.body);
+					break;
+				case ast_if:
+					pending.push_back(stmt->ifn.cond);
+					pending.push_back(stmt->ifn.if_body);
+					if (stmt->ifn.else_body != NULL)
+						pending.push_back(stmt->ifn.else_body);
+					break;
+				case ast_asgn:
+					pending.push_back(stmt->asgn.lhs);
+					pending.push_back(stmt->asgn.rhs);
+					break;
+				case ast_decl:
+					break;
+				default: {
+							fprintf(stderr,"Incorrect node type\n");
+							exit(1);
+						 }
+			}
+			break;
+		}
 		default: {
 					fprintf(stderr,"Incorrect node type\n");
 				 	exit(1);
 				 }
 	}
+	astFree(node);
+}
+
+/* free function for releasing all the memory assigned to a node and
+everything below it. The free* functions of the single node types check
+the type and end up here. */
+
+void freeNode(astNode *node){
+	assert(node != NULL);
+
+	vector<astNode*> pending;
+	pending.push_back(node);
+	while (!pending.empty()){
+		astNode *next = pending.back();
+		pending.pop_back();
+		releaseNode(next, pending);
+	}
 }
 
 /* free function to stmt. To be called when stmt type is not obvious
 from the context */
 void freeStmt(astNode *node){
 	assert(node != NULL && node->type == ast_stmt);
-	
-	switch(node->stmt.type){
-		case ast_call: 
-						freeCall(node);
-						break;
-		case ast_ret: 
-						freeRet(node);
-						break;
-		case ast_block:
-						freeBlock(node);
-						break;
-		case ast_while:
-						freeWhile(node);
-						break;
-		case ast_if: 
-						freeIf(node);
-						break;
-		case ast_asgn:	
-						freeAsgn(node);
-						break;
-		case ast_decl:	
-						 freeDecl(node);
-						 break;
-		default: {
-					fprintf(stderr,"Incorrect node type\n");
-				 	exit(1);
-				 };
-	}
+	freeNode(node);
 }
 
-void printNode(astNode *node, int n){
-	assert(node != NULL);
+/* Printing keeps its own stack of lines still to print, so deep trees do
+not overflow the native stack. An entry is either a node, printed at the
+given indentation, or a fixed label line when node is NULL. */
+typedef struct {
+	astNode *node;
+	const char *label;
+	int n;
+} printItem;
+
+/* local helper: pushes the entries of items[] in reverse so that they come
+off the stack in the order given */
+static void pushPrint(vector<printItem> &todo, const printItem *items, int count){
+	for (int i = count - 1; i >= 0; i--)
+		if (items[i].node != NULL || items[i].label != NULL)
+			todo.push_back(items[i]);
+}
+
+static void expandStmt(astStmt *stmt, int n, vector<printItem> &todo);
+
+/* local helper: prints the line of a single node and pushes its children */
+static void expandNode(astNode *node, int n, vector<printItem> &todo){
 	char *indent = get_indent_str(n);
 	
 	switch(node->type){
 		case ast_prog:{
 						printf("%sProg:\n",indent);
-						printNode(node->prog.func, n+1);
+						printItem items[] = {{node->prog.func, NULL, n+1}};
+						pushPrint(todo, items, 1);
 						break;
 					  }
 		case ast_func:{
 						printf("%sFunc: %s\n",indent, node->func.name);
-						if (node->func.param != NULL)
-							printNode(node->func.param, n+1);
-
-						printNode(node->func.body, n+1);
+						printItem items[] = {{node->func.param, NULL, n+1}, {node->func.body, NULL, n+1}, {node->func.next, NULL, n}};
+						pushPrint(todo, items, 3);
 						break;
 					  }
 		case ast_stmt:{
 						printf("%sStmt: \n",indent);
-						astStmt stmt= node->stmt;
-						printStmt(&stmt, n+1);
+						expandStmt(&(node->stmt), n+1, todo);
 						break;
 					  }
 		case ast_extern:{
@@ -489,19 +628,20 @@ void printNode(astNode *node, int n){
 					  }
 		case ast_rexpr: {
 						printf("%sRExpr: \n", indent);
-						printNode(node->rexpr.lhs, n+1);
-						printNode(node->rexpr.rhs, n+1);
+						printItem items[] = {{node->rexpr.lhs, NULL, n+1}, {node->rexpr.rhs, NULL, n+1}};
+						pushPrint(todo, items, 2);
 						break;
 					  }
 		case ast_bexpr: {
 						printf("%sBExpr: \n", indent);
-						printNode(node->bexpr.lhs, n+1);
-						printNode(node->bexpr.rhs, n+1);
+						printItem items[] = {{node->bexpr.lhs, NULL, n+1}, {node->bexpr.rhs, NULL, n+1}};
+						pushPrint(todo, items, 2);
 						break;
 					  }
 		case ast_uexpr: {
 						printf("%sUExpr: \n", indent);
-						printNode(node->uexpr.expr, n+1);
+						printItem items[] = {{node->uexpr.expr, NULL, n+1}};
+						pushPrint(todo, items, 1);
 						break;
 					  }
 		default: {
@@ -512,8 +652,7 @@ void printNode(astNode *node, int n){
 	free(indent);
 }
 
-void printStmt(astStmt *stmt, int n){
-	assert(stmt != NULL);
+static void expandStmt(astStmt *stmt, int n, vector<printItem> &todo){
 	char *indent = get_indent_str(n);
 
 	switch(stmt->type){
@@ -521,49 +660,50 @@ void printStmt(astStmt *stmt, int n){
 							printf("%sCall: name %s\n", indent, stmt->call.name);
 							if (stmt->call.param != NULL){
 								printf("%sCall: param\n", indent);
-								printNode(stmt->call.param, n+1);
+								printItem items[] = {{stmt->call.param, NULL, n+1}};
+								pushPrint(todo, items, 1);
 							}
 							break;
 						}
 		case ast_ret: {
 							printf("%sRet:\n", indent);
-							printNode(stmt->ret.expr, n+1);
+							printItem items[] = {{stmt->ret.expr, NULL, n+1}};
+							pushPrint(todo, items, 1);
 							break;
 						}
 		case ast_block: {
 							printf("%sBlock:\n", indent);
-							vector<astNode*> slist = *(stmt->block.stmt_list);
-							vector<astNode*>::iterator it = slist.begin();
-							while (it != slist.end()){
-								printNode(*it, n+1);
-								it++;
+							astList *slist = stmt->block.stmt_list;
+							for (astList::reverse_iterator it = slist->rbegin(); it != slist->rend(); it++){
+								printItem item = {*it, NULL, n+1};
+								todo.push_back(item);
 							}
 							break;
 						}
 		case ast_while: {
 							printf("%sWhile: cond \n", indent);
-							printNode(stmt->whilen.cond, n+1);
-							printf("%sWhile: body \n", indent);
-							printNode(stmt->whilen.body, n+1);
+							printItem items[] = {{stmt->whilen.cond, NULL, n+1},
+												 {NULL, "While: body ", n},
+												 {stmt->whilen.body, NULL, n+1}};
+							pushPrint(todo, items, 3);
 							break;
 						}
 		case ast_if: {
 							printf("%sIf: cond\n", indent);
-							printNode(stmt->ifn.cond, n+1);
-							printf("%sIf: body\n", indent);
-							printNode(stmt->ifn.if_body, n+1);
-							if (stmt->ifn.else_body != NULL)
-							{
-								printf("%sElse: body\n", indent);
-								printNode(stmt->ifn.else_body, n+1);
-							}
+							printItem items[] = {{stmt->ifn.cond, NULL, n+1},
+												 {NULL, "If: body", n},
+												 {stmt->ifn.if_body, NULL, n+1},
+												 {NULL, stmt->ifn.else_body != NULL ? "Else: body" : NULL, n},
+												 {stmt->ifn.else_body, NULL, n+1}};
+							pushPrint(todo, items, 5);
 							break;
 						}
 		case ast_asgn:	{
 							printf("%sAsgn: lhs\n", indent);
-							printNode(stmt->asgn.lhs, n+1);
-							printf("%sAsgn: rhs\n", indent);
-							printNode(stmt->asgn.rhs, n+1);
+							printItem items[] = {{stmt->asgn.lhs, NULL, n+1},
+												 {NULL, "Asgn: rhs", n},
+												 {stmt->asgn.rhs, NULL, n+1}};
+							pushPrint(todo, items, 3);
 							break;
 						}
 		case ast_decl:	{
@@ -577,3 +717,32 @@ void printStmt(astStmt *stmt, int n){
 	}
 	free(indent);
 }
+
+/* local helper: prints everything left on the stack */
+static void printAll(vector<printItem> &todo){
+	while (!todo.empty()){
+		printItem item = todo.back();
+		todo.pop_back();
+		if (item.node != NULL){
+			expandNode(item.node, item.n, todo);
+		} else {
+			char *indent = get_indent_str(item.n);
+			printf("%s%s\n", indent, item.label);
+			free(indent);
+		}
+	}
+}
+
+void printNode(astNode *node, int n){
+	assert(node != NULL);
+	vector<printItem> todo;
+	expandNode(node, n, todo);
+	printAll(todo);
+}
+
+void printStmt(astStmt *stmt, int n){
+	assert(stmt != NULL);
+	vector<printItem> todo;
+	expandStmt(stmt, n, todo);
+	printAll(todo);
+}
@@ -3,6 +3,8 @@
 
 #include <cstddef>
 #include<vector>
+#include "arena.h"
+#include "intern.h"
 using namespace std;
 
 struct ast_Node;
@@ -11,6 +13,9 @@ typedef struct ast_Node astNode;
 struct ast_Stmt;
 typedef struct ast_Stmt astStmt;
 
+// list of statements in a block, allocated from the AST arena when one is set
+typedef vector<astNode*, arena_allocator<astNode*> > astList;
+
 //enum to identify node type
 typedef enum {
 		ast_prog,
@@ -58,21 +63,28 @@ typedef enum {
 typedef struct {
 	 	astNode* ext1; //extern function print
 		astNode* ext2; //extern function read
-		astNode* func; //function defined in input miniC program
+		astNode* func; //first function defined in input miniC program, the others follow through func.next
 	} astProg;
 
 typedef struct {
-		char* name; // name of the function
+		const char* name; // name of the function
+		symId sym; // interned id of name
 		astNode* param; // parameter, possibly NULL if the function doesn't take a param
 		astNode* body; //function body
+		astList* locals; // parameter and local declarations in slot order, set by semantic analysis
+		astNode* next; // next function in the source, NULL for the last
 	} astFunc;
 
 typedef struct {
-		char* name; // For extern functions defined we will only save function names
+		const char* name; // For extern functions defined we will only save function names
+		symId sym;
 	} astExtern;
 
 typedef struct {
-		char* name;
+		const char* name;
+		symId sym; // interned id of name, compare these instead of strings
+		astNode* decl; // declaration this use resolves to, set by semantic analysis
+		int slot; // slot of decl, copied so the IR builder indexes its locals directly
 	} astVar; 
 
 typedef struct {
@@ -98,8 +110,9 @@ typedef struct {
 
 /* structs for different statement types */
 typedef struct {
-		char* name;
-		astNode* param; // For read function this field will be NULL
+		const char* name;
+		symId sym;
+		astNode* param; // For read and functions without a parameter this field will be NULL
 	} astCall;
 
 typedef struct {
@@ -107,7 +120,7 @@ typedef struct {
 	} astRet;
 
 typedef struct {
-		vector<astNode*> *stmt_list;
+		astList *stmt_list;
 	} astBlock;
 
 typedef struct {
@@ -122,7 +135,9 @@ typedef struct {
 	} astIf;
 
 typedef struct {
-		char* name;
+		const char* name;
+		symId sym;
+		int slot; // index of the declaration in its function's locals, set by semantic analysis
 	} astDecl;
 
 typedef struct {
@@ -145,6 +160,7 @@ struct ast_Stmt{
 
 struct ast_Node{
 		node_type type;
+		bool shared; // from the hash-consing table, may have several parents
 		union {
 		  astProg   prog;
 		  astFunc   func;
@@ -159,15 +175,45 @@ struct ast_Node{
 	};
 
 
+/*
+All nodes and statement lists are allocated through the functions
+below; names live in the intern table. When an arena is set with
+setAstArena they come from the arena and the free* functions leave them
+alone; the whole tree is then released at once by releasing the arena.
+Without an arena they use the heap.
+*/
+
+void setAstArena(astArena* arena);
+astArena* getAstArena();
+void* astAlloc(size_t size);
+void astFree(void* ptr);
+astList* createList();
+
+/*
+Hash-consing of side-effect free expressions, see ast.c. While it is
+on, the create* functions of ast_var, ast_cnst and the expression nodes
+return an existing equal node where one may be reused, so the
+expressions of a function form a DAG. It needs an arena to be set.
+hashConsHits counts the nodes that were reused.
+*/
+void setHashCons(bool on);
+size_t hashConsHits();
+
 /* 
 Declarations of create* functions for all the types of nodes 
 defined above. All the create* functions return a astNode*. 
+Names are interned (see intern.h) rather than copied into the node;
+the overloads taking a symId skip the lookup when the caller already
+has the id.
 */
 
 astNode* createProg(astNode* extern1, astNode* extern2, astNode* func);
 astNode* createFunc(const char* name, astNode* param, astNode* body);
+astNode* createFunc(symId name, astNode* param, astNode* body);
 astNode* createExtern(const char *name);
+astNode* createExtern(symId name);
 astNode* createVar(const char *name);
+astNode* createVar(symId name);
 astNode* createCnst(int value);
 astNode* createRExpr(astNode* lhs, astNode* rhs, rop_type op);
 astNode* createBExpr(astNode* lhs, astNode* rhs, op_type op);
@@ -181,11 +227,13 @@ a astNode*.
 */
 
 astNode* createCall(const char *name, astNode *param=NULL);
+astNode* createCall(symId name, astNode *param=NULL);
 astNode* createRet(astNode* expr);
-astNode* createBlock(vector<astNode*> *stmt_list);
+astNode* createBlock(astList *stmt_list);
 astNode* createWhile(astNode* cond, astNode* body);
 astNode* createIf(astNode* cond, astNode* if_body, astNode* else_body=NULL);
 astNode* createDecl(const char* decl);
+astNode* createDecl(symId decl);
 astNode* createAsgn(astNode* lhs, astNode* rhs);
 
 /* 
@@ -2,8 +2,8 @@
 #include <stdio.h>
 
 int main(){
-	vector<astNode*> *slist;
-	slist = new vector<astNode*> ();
+	astList *slist;
+	slist = createList();
 
 	astNode *a11 = createVar("test1"); //create a variable node test1
 	astNode *a12 = createCnst(20); //create a integer constant
@@ -0,0 +1,413 @@
+#include"flat.h"
+#include<stdio.h>
+#include<stdlib.h>
+#include<utility>
+
+void initFlatAst(flatAst *ast){
+	ast->type.clear();
+	ast->kind.clear();
+	ast->a.clear();
+	ast->b.clear();
+	ast->c.clear();
+	ast->end.clear();
+	ast->kids.clear();
+	ast->root = FLAT_NONE;
+}
+
+/* local helper: append a node to ast */
+static astIdx newNode(flatAst *ast, node_type type, int kind, uint32_t a, uint32_t b, uint32_t c){
+	astIdx idx = ast->type.size();
+	ast->type.push_back(type);
+	ast->kind.push_back(kind);
+	ast->a.push_back(a);
+	ast->b.push_back(b);
+	ast->c.push_back(c);
+	return idx;
+}
+
+/* local helper: the children of a node other than the program or a
+block, in source order. Returns how many were written to out. */
+static int fixedChildren(const flatAst *ast, astIdx i, astIdx out[3]){
+	int n = 0;
+	uint32_t a = ast->a[i], b = ast->b[i], c = ast->c[i];
+
+	switch(ast->type[i]){
+		case ast_func:
+			if (b != FLAT_NONE) out[n++] = b;
+			out[n++] = c;
+			break;
+		case ast_rexpr:
+		case ast_bexpr:
+			out[n++] = a;
+			out[n++] = b;
+			break;
+		case ast_uexpr:
+			out[n++] = a;
+			break;
+		case ast_stmt:
+			switch(ast->kind[i]){
+				case ast_call:
+					if (b != FLAT_NONE) out[n++] = b;
+					break;
+				case ast_ret:
+					out[n++] = a;
+					break;
+				case ast_while:
+				case ast_asgn:
+					out[n++] = a;
+					out[n++] = b;
+					break;
+				case ast_if:
+					out[n++] = a;
+					out[n++] = b;
+					if (c != FLAT_NONE) out[n++] = c;
+					break;
+				default:
+					break;
+			}
+			break;
+		default:
+			break;
+	}
+	return n;
+}
+
+// the program and blocks keep their children in kids
+static bool hasKids(const flatAst *ast, astIdx i){
+	return ast->type[i] == ast_prog || (ast->type[i] == ast_stmt && ast->kind[i] == ast_block);
+}
+
+/* Reorder the nodes below root into preorder and fill in end. */
+static void finishFlatAst(flatAst *ast, astIdx root){
+	size_t n = ast->type.size();
+	vector<astIdx> order; // old indices in preorder
+	vector<astIdx> renum(n, FLAT_NONE); // old index -> new index
+	vector<astIdx> work;
+
+	order.reserve(n);
+	work.push_back(root);
+	while (!work.empty()){
+		astIdx i = work.back();
+		work.pop_back();
+		renum[i] = order.size();
+		order.push_back(i);
+
+		// push in reverse so the first child is visited first
+		if (hasKids(ast, i)){
+			for (uint32_t k = ast->b[i]; k > 0; k--)
+				work.push_back(ast->kids[ast->a[i] + k - 1]);
+		} else {
+			astIdx kids[3];
+			int nkids = fixedChildren(ast, i, kids);
+			for (int k = nkids - 1; k >= 0; k--)
+				work.push_back(kids[k]);
+		}
+	}
+
+	flatAst out;
+	initFlatAst(&out);
+	size_t m = order.size();
+	out.type.resize(m);
+	out.kind.resize(m);
+	out.a.resize(m);
+	out.b.resize(m);
+	out.c.resize(m);
+	out.end.resize(m);
+
+	for (size_t p = 0; p < m; p++){
+		astIdx o = order[p];
+		uint32_t a = ast->a[o], b = ast->b[o], c = ast->c[o];
+		out.type[p] = ast->type[o];
+		out.kind[p] = ast->kind[o];
+
+		if (hasKids(ast, o)){
+			uint32_t first = out.kids.size();
+			for (uint32_t k = 0; k < b; k++)
+				out.kids.push_back(renum[ast->kids[a + k]]);
+			a = first;
+		} else {
+			// rewrite whichever columns hold child indices
+			switch(ast->type[o]){
+				case ast_func:
+					b = b == FLAT_NONE ? b : renum[b];
+					c = renum[c];
+					break;
+				case ast_rexpr:
+				case ast_bexpr:
+					a = renum[a];
+					b = renum[b];
+					break;
+				case ast_uexpr:
+					a = renum[a];
+					break;
+				case ast_var:
+					b = b == FLAT_NONE ? b : renum[b];
+					break;
+				case ast_stmt:
+					switch(ast->kind[o]){
+						case ast_call:
+							b = b == FLAT_NONE ? b : renum[b];
+							break;
+						case ast_ret:
+							a = renum[a];
+							break;
+						case ast_while:
+						case ast_asgn:
+							a = renum[a];
+							b = renum[b];
+							break;
+						case ast_if:
+							a = renum[a];
+							b = renum[b];
+							c = c == FLAT_NONE ? c : renum[c];
+							break;
+						default:
+							break;
+					}
+					break;
+				default:
+					break;
+			}
+		}
+		out.a[p] = a;
+		out.b[p] = b;
+		out.c[p] = c;
+	}
+
+	// children come after their parent, so subtree ends fill in back to front
+	for (size_t p = m; p > 0; p--){
+		astIdx i = p - 1;
+		astIdx last = i + 1;
+		if (hasKids(&out, i)){
+			if (out.b[i] > 0)
+				last = out.end[out.kids[out.a[i] + out.b[i] - 1]];
+		} else {
+			astIdx kids[3];
+			int nkids = fixedChildren(&out, i, kids);
+			if (nkids > 0)
+				last = out.end[kids[nkids - 1]];
+		}
+		out.end[i] = last;
+	}
+
+	out.root = m > 0 ? 0 : FLAT_NONE;
+	*ast = std::move(out);
+}
+
+void flattenAst(flatAst *ast, astNode *root){
+	initFlatAst(ast);
+
+	// post-order walk with an explicit stack; results of the children of
+	// a node are on vals in source order when the node is revisited
+	vector<pair<astNode*, bool> > work;
+	vector<astIdx> vals;
+	vector<astNode*> list_kids;
+	work.push_back(make_pair(root, false));
+
+	while (!work.empty()){
+		astNode *node = work.back().first;
+		bool done = work.back().second;
+		work.pop_back();
+
+		astNode *kids[3] = {NULL, NULL, NULL};
+		vector<astNode*> *list = NULL;
+		switch(node->type){
+			case ast_prog:
+				// the externs and the chain of functions, as one list
+				list_kids.clear();
+				if (node->prog.ext1 != NULL) list_kids.push_back(node->prog.ext1);
+				if (node->prog.ext2 != NULL) list_kids.push_back(node->prog.ext2);
+				for (astNode *f = node->prog.func; f != NULL; f = f->func.next)
+					list_kids.push_back(f);
+				list = &list_kids;
+				break;
+			case ast_func:
+				kids[0] = node->func.param;
+				kids[1] = node->func.body;
+				break;
+			case ast_rexpr:
+				kids[0] = node->rexpr.lhs;
+				kids[1] = node->rexpr.rhs;
+				break;
+			case ast_bexpr:
+				kids[0] = node->bexpr.lhs;
+				kids[1] = node->bexpr.rhs;
+				break;
+			case ast_uexpr:
+				kids[0] = node->uexpr.expr;
+				break;
+			case ast_stmt:
+				switch(node->stmt.type){
+					case ast_call:
+						kids[0] = node->stmt.call.param;
+						break;
+					case ast_ret:
+						kids[0] = node->stmt.ret.expr;
+						break;
+					case ast_block:
+						list = &list_kids;
+						list_kids.assign(node->stmt.block.stmt_list->begin(), node->stmt.block.stmt_list->end());
+						break;
+					case ast_while:
+						kids[0] = node->stmt.whilen.cond;
+						kids[1] = node->stmt.whilen.body;
+						break;
+					case ast_if:
+						kids[0] = node->stmt.ifn.cond;
+						kids[1] = node->stmt.ifn.if_body;
+						kids[2] = node->stmt.ifn.else_body;
+						break;
+					case ast_asgn:
+						kids[0] = node->stmt.asgn.lhs;
+						kids[1] = node->stmt.asgn.rhs;
+						break;
+					default:
+						break;
+				}
+				break;
+			default:
+				break;
+		}
+
+		if (!done){
+			work.push_back(make_pair(node, true));
+			if (list != NULL){
+				for (size_t k = list->size(); k > 0; k--)
+					work.push_back(make_pair((*list)[k - 1], false));
+			} else {
+				for (int k = 2; k >= 0; k--)
+					if (kids[k] != NULL)
+						work.push_back(make_pair(kids[k], false));
+			}
+			continue;
+		}
+
+		// the children's indices: a list's go to kids, the others are
+		// popped into idx with NULL children as FLAT_NONE
+		astIdx idx[3] = {FLAT_NONE, FLAT_NONE, FLAT_NONE};
+		if (list != NULL){
+			idx[0] = ast->kids.size();
+			idx[1] = list->size();
+			ast->kids.insert(ast->kids.end(), vals.end() - list->size(), vals.end());
+			vals.resize(vals.size() - list->size());
+		} else {
+			for (int k = 2; k >= 0; k--){
+				if (kids[k] != NULL){
+					idx[k] = vals.back();
+					vals.pop_back();
+				}
+			}
+		}
+
+		astIdx ret = FLAT_NONE;
+		switch(node->type){
+			case ast_prog:
+				ret = newNode(ast, ast_prog, 0, idx[0], idx[1], FLAT_NONE);
+				break;
+			case ast_func:
+				ret = newNode(ast, ast_func, 0, node->func.sym, idx[0], idx[1]);
+				break;
+			case ast_extern:
+				ret = newNode(ast, ast_extern, 0, node->ext.sym, FLAT_NONE, FLAT_NONE);
+				break;
+			case ast_var:
+				ret = newNode(ast, ast_var, 0, node->var.sym, FLAT_NONE, FLAT_NONE);
+				break;
+			case ast_cnst:
+				ret = newNode(ast, ast_cnst, 0, (uint32_t) node->cnst.value, FLAT_NONE, FLAT_NONE);
+				break;
+			case ast_rexpr:
+				ret = newNode(ast, ast_rexpr, node->rexpr.op, idx[0], idx[1], FLAT_NONE);
+				break;
+			case ast_bexpr:
+				ret = newNode(ast, ast_bexpr, node->bexpr.op, idx[0], idx[1], FLAT_NONE);
+				break;
+			case ast_uexpr:
+				ret = newNode(ast, ast_uexpr, node->uexpr.op, idx[0], FLAT_NONE, FLAT_NONE);
+				break;
+			case ast_stmt:
+				switch(node->stmt.type){
+					case ast_call:
+						ret = newNode(ast, ast_stmt, ast_call, node->stmt.call.sym, idx[0], FLAT_NONE);
+						break;
+					case ast_decl:
+						ret = newNode(ast, ast_stmt, ast_decl, node->stmt.decl.sym, FLAT_NONE, FLAT_NONE);
+						break;
+					default:
+						ret = newNode(ast, ast_stmt, node->stmt.type, idx[0], idx[1], idx[2]);
+						break;
+				}
+				break;
+		}
+		vals.push_back(ret);
+	}
+
+	finishFlatAst(ast, vals.back());
+}
+
+size_t flatAstBytes(const flatAst *ast){
+	return ast->type.capacity() * sizeof(uint8_t)
+		+ ast->kind.capacity() * sizeof(uint8_t)
+		+ (ast->a.capacity() + ast->b.capacity() + ast->c.capacity()) * sizeof(uint32_t)
+		+ (ast->end.capacity() + ast->kids.capacity()) * sizeof(astIdx);
+}
+
+int flatResolve(flatAst *ast){
+	typedef struct {
+		symId sym;
+		astIdx decl;
+		int prev; // binding this one shadows
+	} binding;
+
+	vector<int> innermost(numSyms(), -1);
+	vector<binding> binds;
+	vector<pair<astIdx, size_t> > scopes; // (end of scope, binds.size() at entry)
+	uint32_t next_slot = 0;
+	size_t n = ast->type.size();
+
+	for (astIdx i = 0; i < n; i++){
+		// leave every scope whose subtree we have walked past
+		while (!scopes.empty() && i >= scopes.back().first){
+			while (binds.size() > scopes.back().second){
+				innermost[binds.back().sym] = binds.back().prev;
+				binds.pop_back();
+			}
+			scopes.pop_back();
+		}
+
+		switch(ast->type[i]){
+			case ast_func:
+				next_slot = 0;
+				scopes.push_back(make_pair(ast->end[i], binds.size()));
+				break;
+			case ast_var: {
+				int bind = innermost[ast->a[i]];
+				if (bind < 0){
+					printf("Error: variable {%s} not declared\n", symName(ast->a[i]));
+					return -1;
+				}
+				ast->b[i] = binds[bind].decl;
+				break;
+			}
+			case ast_stmt:
+				if (ast->kind[i] == ast_block){
+					scopes.push_back(make_pair(ast->end[i], binds.size()));
+				} else if (ast->kind[i] == ast_decl){
+					symId sym = ast->a[i];
+					int prev = innermost[sym];
+					if (prev >= 0 && (size_t) prev >= scopes.back().second){
+						printf("Error: can only have one declaration in a scope\n");
+						return -1;
+					}
+					binding b = {sym, i, prev};
+					innermost[sym] = binds.size();
+					binds.push_back(b);
+					ast->b[i] = next_slot++;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return 0;
+}
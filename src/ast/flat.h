@@ -0,0 +1,71 @@
+#ifndef FLAT_H
+#define FLAT_H
+
+#include <cstdint>
+#include <vector>
+#include "ast.h"
+
+/*
+Flat copy of an astNode tree, for flat_bench to measure the layout
+against the pointer tree. Nodes live in parallel arrays (structure of
+arrays) and refer to each other by 32-bit index instead of by pointer.
+Every node has the same three payload columns a, b and c; what they hold
+depends on the node:
+
+	ast_prog                a=first child in kids   b=number of children
+	                        (the externs, then every function in source order)
+	ast_func                a=sym   b=param c=body
+	ast_extern              a=sym
+	ast_var                 a=sym   b=decl (set by flatResolve)
+	ast_cnst                a=value
+	ast_rexpr, ast_bexpr    a=lhs   b=rhs         (kind = op)
+	ast_uexpr               a=expr                (kind = op)
+	ast_stmt (kind = stmt_type):
+		ast_call            a=sym   b=param
+		ast_ret             a=expr
+		ast_block           a=first child in kids   b=number of children
+		ast_while           a=cond  b=body
+		ast_if              a=cond  b=if_body c=else_body
+		ast_decl            a=sym   b=slot (set by flatResolve)
+		ast_asgn            a=lhs   b=rhs
+
+Missing children are FLAT_NONE. The nodes are stored in preorder: the
+subtree of node i is exactly the index range [i, end[i]), so a pass that
+only needs to see every node can sweep the arrays front to back.
+
+The compiler itself does not use it: the parser, semantic analysis and
+the IR builder work on astNode.
+*/
+
+typedef uint32_t astIdx;
+
+#define FLAT_NONE ((astIdx) -1)
+
+typedef struct {
+		vector<uint8_t> type; // node_type
+		vector<uint8_t> kind; // stmt_type for ast_stmt, op for expressions
+		vector<uint32_t> a;
+		vector<uint32_t> b;
+		vector<uint32_t> c;
+		vector<astIdx> end; // one past the last node of the subtree
+		vector<astIdx> kids; // children of the program and of blocks
+		astIdx root;
+	} flatAst;
+
+void initFlatAst(flatAst* ast);
+
+/* Build the flat layout of a pointer tree. */
+void flattenAst(flatAst* ast, astNode* root);
+
+/* Number of bytes held by the arrays of ast. */
+size_t flatAstBytes(const flatAst* ast);
+
+/*
+Scope check in a single front-to-back sweep: every ast_var gets the
+index of its declaration and every ast_decl a slot number that is unique
+within its function. Returns -1 after printing an error if a variable is
+undeclared or declared twice in one scope.
+*/
+int flatResolve(flatAst* ast);
+
+#endif
@@ -0,0 +1,208 @@
+/*
+Compares the pointer astNode tree with the flat layout of flat.h on a
+large generated program: resident memory taken by each and the time of
+a full traversal. The statements are split over functions of at most
+FUNC_STMTS each, chained the way the parser chains them. The flat layout
+is built by flattening the tree. Build with `make bench` and run
+	./flat_bench [statements] [repeats]
+*/
+#include "ast.h"
+#include "flat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_VARS 64
+#define FUNC_STMTS 50000
+
+static long residentBytes(){
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static astNode* generateFunc(long first, long num_stmts, symId *vars, symId param, symId fname){
+	astList *body = createList();
+
+	for (int i = 0; i < NUM_VARS; i++)
+		body->push_back(createDecl(vars[i]));
+
+	for (long s = first; s < first + num_stmts; s++){
+		symId x = vars[s % NUM_VARS], y = vars[(s * 7 + 3) % NUM_VARS], z = vars[(s * 13 + 5) % NUM_VARS];
+		astNode *stmt;
+		switch (s % 4){
+			case 0: // x = y * z + s;
+				stmt = createAsgn(createVar(x), createBExpr(createBExpr(createVar(y), createVar(z), mul), createCnst(s), add));
+				break;
+			case 1: { // while (x < p) { y = y + 1; }
+				astList *l = createList();
+				l->push_back(createAsgn(createVar(y), createBExpr(createVar(y), createCnst(1), add)));
+				stmt = createWhile(createRExpr(createVar(x), createVar(param), lt), createBlock(l));
+				break;
+			}
+			case 2: { // if (x > s) { z = -y; } else { z = s; }
+				astList *t = createList();
+				astList *e = createList();
+				t->push_back(createAsgn(createVar(z), createUExpr(createVar(y), uminus)));
+				e->push_back(createAsgn(createVar(z), createCnst(s)));
+				stmt = createIf(createRExpr(createVar(x), createCnst(s), gt), createBlock(t), createBlock(e));
+				break;
+			}
+			default: // x = x - y;
+				stmt = createAsgn(createVar(x), createBExpr(createVar(x), createVar(y), sub));
+				break;
+		}
+		body->push_back(stmt);
+	}
+	body->push_back(createRet(createVar(vars[0])));
+	return createFunc(fname, createDecl(param), createBlock(body));
+}
+
+static astNode* generate(long num_stmts, symId *vars, symId param){
+	astNode *first = NULL, *last = NULL;
+	char name[16];
+	for (long s = 0, f = 0; s == 0 || s < num_stmts; s += FUNC_STMTS, f++){
+		snprintf(name, sizeof(name), "f%ld", f);
+		long n = num_stmts - s < FUNC_STMTS ? num_stmts - s : FUNC_STMTS;
+		astNode *func = generateFunc(s, n, vars, param, internName(name));
+		if (last == NULL) first = func;
+		else last->func.next = func;
+		last = func;
+	}
+	return createProg(createExtern("print"), createExtern("read"), first);
+}
+
+/* a full walk of the pointer tree, shaped like traverseRoot */
+static long walkTree(astNode *node){
+	if (node == NULL)
+		return 0;
+	switch(node->type){
+		case ast_prog: {
+			long sum = 1 + walkTree(node->prog.ext1) + walkTree(node->prog.ext2);
+			for (astNode *f = node->prog.func; f != NULL; f = f->func.next)
+				sum += walkTree(f);
+			return sum;
+		}
+		case ast_func:
+			return 1 + walkTree(node->func.param) + walkTree(node->func.body);
+		case ast_var:
+			return 1 + node->var.sym;
+		case ast_cnst:
+			return 1 + node->cnst.value;
+		case ast_rexpr:
+			return 1 + walkTree(node->rexpr.lhs) + walkTree(node->rexpr.rhs);
+		case ast_bexpr:
+			return 1 + walkTree(node->bexpr.lhs) + walkTree(node->bexpr.rhs);
+		case ast_uexpr:
+			return 1 + walkTree(node->uexpr.expr);
+		case ast_stmt: {
+			astStmt *s = &(node->stmt);
+			switch(s->type){
+				case ast_call: return 1 + walkTree(s->call.param);
+				case ast_ret: return 1 + walkTree(s->ret.expr);
+				case ast_while: return 1 + walkTree(s->whilen.cond) + walkTree(s->whilen.body);
+				case ast_if: return 1 + walkTree(s->ifn.cond) + walkTree(s->ifn.if_body) + walkTree(s->ifn.else_body);
+				case ast_asgn: return 1 + walkTree(s->asgn.lhs) + walkTree(s->asgn.rhs);
+				case ast_decl: return 1 + s->decl.sym;
+				case ast_block: {
+					long sum = 1;
+					for (astNode *n : *(s->block.stmt_list))
+						sum += walkTree(n);
+					return sum;
+				}
+			}
+		}
+		default:
+			return 1;
+	}
+}
+
+/* the same walk over the flat layout is a single sweep */
+static long walkFlat(const flatAst *ast){
+	long sum = 0;
+	size_t n = ast->type.size();
+	for (size_t i = 0; i < n; i++){
+		switch(ast->type[i]){
+			case ast_var:
+			case ast_cnst:
+				sum += 1 + (int) ast->a[i];
+				break;
+			case ast_stmt:
+				sum += 1 + (ast->kind[i] == ast_decl ? (int) ast->a[i] : 0);
+				break;
+			default:
+				sum += 1;
+				break;
+		}
+	}
+	return sum;
+}
+
+int main(int argc, char **argv){
+	long num_stmts = argc > 1 ? atol(argv[1]) : 200000;
+	int repeats = argc > 2 ? atoi(argv[2]) : 10;
+
+	symId vars[NUM_VARS];
+	char name[16];
+	for (int i = 0; i < NUM_VARS; i++){
+		snprintf(name, sizeof(name), "v%d", i);
+		vars[i] = internName(name);
+	}
+	symId param = internName("p");
+
+	long base = residentBytes();
+	astArena arena;
+	arenaInit(&arena);
+	setAstArena(&arena);
+	double t0 = now();
+	astNode *tree = generate(num_stmts, vars, param);
+	double tree_build = now() - t0;
+	long tree_rss = residentBytes() - base;
+
+	base = residentBytes();
+	flatAst ast;
+	t0 = now();
+	flattenAst(&ast, tree);
+	double flat_build = now() - t0;
+	long flat_rss = residentBytes() - base;
+
+	long tree_sum = 0, flat_sum = 0;
+	t0 = now();
+	for (int r = 0; r < repeats; r++)
+		tree_sum += walkTree(tree);
+	double tree_walk = (now() - t0) / repeats;
+
+	t0 = now();
+	for (int r = 0; r < repeats; r++)
+		flat_sum += walkFlat(&ast);
+	double flat_walk = (now() - t0) / repeats;
+
+	t0 = now();
+	int resolved = flatResolve(&ast);
+	double flat_resolve = now() - t0;
+
+	printf("%ld statements in %u functions, %zu nodes\n", num_stmts, ast.b[ast.root] - 2, ast.type.size());
+	printf("%-8s %12s %12s %12s\n", "layout", "build (ms)", "walk (ms)", "RSS (KiB)");
+	printf("%-8s %12.2f %12.2f %12ld\n", "pointer", tree_build * 1e3, tree_walk * 1e3, tree_rss / 1024);
+	printf("%-8s %12.2f %12.2f %12ld\n", "flat", flat_build * 1e3, flat_walk * 1e3, flat_rss / 1024);
+	printf("pointer tree: %zu bytes in the arena, flat arrays: %zu bytes\n", arena.bytes_used, flatAstBytes(&ast));
+	printf("flatResolve: %.2f ms%s\n", flat_resolve * 1e3, resolved == 0 ? "" : " (failed)");
+	if (tree_sum != flat_sum)
+		printf("walks disagree: %ld vs %ld\n", tree_sum, flat_sum);
+
+	setAstArena(NULL);
+	arenaRelease(&arena);
+	return 0;
+}
@@ -0,0 +1,89 @@
+#include"intern.h"
+#include"arena.h"
+#include<stdint.h>
+#include<string.h>
+#include<vector>
+
+using namespace std;
+
+static vector<const char*> sym_names; // id -> interned string
+static vector<size_t> sym_lens;
+static vector<symId> buckets; // open addressing, NO_SYM marks an empty slot
+static astArena pool; // storage for the interned strings
+static bool pool_ready = false;
+
+/* local helper: FNV-1a over the bytes of the name */
+static uint32_t hashName(const char *name, size_t len){
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++){
+		h ^= (unsigned char) name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/* local helper: double the bucket array and re-insert all ids */
+static void grow(){
+	size_t size = buckets.empty() ? 256 : buckets.size() * 2;
+	buckets.assign(size, NO_SYM);
+
+	for (symId id = 0; id < (symId) sym_names.size(); id++){
+		size_t slot = hashName(sym_names[id], sym_lens[id]) & (size - 1);
+		while (buckets[slot] != NO_SYM)
+			slot = (slot + 1) & (size - 1);
+		buckets[slot] = id;
+	}
+}
+
+symId internName(const char *name, size_t len){
+	// keep the load factor under one half
+	if ((sym_names.size() + 1) * 2 > buckets.size())
+		grow();
+
+	size_t mask = buckets.size() - 1;
+	size_t slot = hashName(name, len) & mask;
+	while (buckets[slot] != NO_SYM){
+		symId id = buckets[slot];
+		if (sym_lens[id] == len && memcmp(sym_names[id], name, len) == 0)
+			return id;
+		slot = (slot + 1) & mask;
+	}
+
+	if (!pool_ready){
+		arenaInit(&pool, 16*1024);
+		pool_ready = true;
+	}
+	char *copy = (char *) arenaAlloc(&pool, len + 1, 1);
+	memcpy(copy, name, len);
+	copy[len] = '\0';
+
+	symId id = (symId) sym_names.size();
+	sym_names.push_back(copy);
+	sym_lens.push_back(len);
+	buckets[slot] = id;
+	return id;
+}
+
+symId internName(const char *name){
+	return internName(name, strlen(name));
+}
+
+const char* symName(symId id){
+	if (id < 0 || id >= (symId) sym_names.size())
+		return NULL;
+	return sym_names[id];
+}
+
+size_t numSyms(){
+	return sym_names.size();
+}
+
+void clearInternTable(){
+	sym_names.clear();
+	sym_lens.clear();
+	buckets.clear();
+	if (pool_ready){
+		arenaRelease(&pool);
+		pool_ready = false;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstddef>
+
+/*
+Identifier table. Every distinct name is stored once and mapped to a
+dense integer id, so names can be compared with an integer compare and
+used to index flat arrays. Ids are handed out in order starting at 0.
+The strings stay valid until clearInternTable is called.
+*/
+
+typedef int symId;
+
+#define NO_SYM (-1)
+
+symId internName(const char* name, size_t len);
+symId internName(const char* name);
+const char* symName(symId id);
+size_t numSyms();
+void clearInternTable();
+
+#endif
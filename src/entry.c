@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <sys/resource.h>
+#include <llvm-c/Analysis.h>
 #include "./ast/ast.h"
 #include "./Frontegg/y.tab.h"
 #include "./Frontegg/semantic.h"
+#include "./Frontegg/parser.h"
+#include "./Frontegg/simplify.h"
+#include "./Frontegg/stream.h"
 #include "./Frontegg/builder.h"
 #include "./Middlegg/opt.h"
 #include "./Backegg/gen_asm.h"
@@ -9,49 +14,194 @@
 extern astNode *root;
 extern FILE *yyin;
 extern int yyparse(astNode **root);
+extern int lexer_open(const char *path);
+extern void lexer_close(void);
 
 int main(int argc, char **argv) {
 
 	astNode *root = NULL;
-	if (argc == 2) {
-		yyin = fopen(argv[1], "r");
-		if (yyin == NULL) {
+	const char *inputfile = NULL;
+	bool stats = false;
+	bool time_report = false;
+	bool optimize = true;
+	int opt_level = 2;
+	const char *passes = NULL;
+	bool dump_ast = false;
+	bool use_rd = false;
+	bool hash_cons = false;
+	bool stream = false;
+	bool emit_llvm = false;
+	bool print_ir = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-stats") == 0) {
+			stats = true;
+		} else if (strcmp(argv[i], "-ftime-report") == 0) {
+			time_report = true;
+		} else if (strcmp(argv[i], "-O0") == 0) {
+			optimize = false;
+		} else if (strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O2") == 0) {
+			optimize = true;
+			opt_level = argv[i][2] - '0';
+		} else if (strncmp(argv[i], "-O", 2) == 0) {
+			fprintf(stderr, "unknown optimization level %s, expected -O0, -O1 or -O2\n", argv[i]);
+			return 1;
+		} else if (strncmp(argv[i], "--passes=", 9) == 0) {
+			passes = argv[i] + 9;
+		} else if (strcmp(argv[i], "--hash-cons") == 0) {
+			hash_cons = true;
+		} else if (strcmp(argv[i], "--stream") == 0) {
+			stream = true;
+		} else if (strcmp(argv[i], "--ssa") == 0) {
+			ssa_mode = true;
+		} else if (strcmp(argv[i], "--no-inline") == 0) {
+			setInlineEnabled(false);
+		} else if (strncmp(argv[i], "--inline-threshold=", 19) == 0) {
+			setInlineThreshold(atoi(argv[i] + 19));
+		} else if (strcmp(argv[i], "--emit-llvm") == 0) {
+			emit_llvm = true;
+		} else if (strcmp(argv[i], "--print-ir") == 0) {
+			print_ir = true;
+		} else if (strcmp(argv[i], "--dump-ast") == 0) {
+			dump_ast = true;
+		} else if (strcmp(argv[i], "--parser=rd") == 0) {
+			use_rd = true;
+		} else if (strcmp(argv[i], "--parser=yacc") == 0) {
+			use_rd = false;
+		} else if (strncmp(argv[i], "--parser=", 9) == 0) {
+			fprintf(stderr, "unknown parser %s, expected rd or yacc\n", argv[i] + 9);
+			return 1;
+		} else {
+			inputfile = argv[i];
+		}
+	}
+
+	// --passes replaces the pipeline of the -O level, and runs even with -O0
+	if (passes != NULL) {
+		if (!setPassPipeline(passes)) return 1;
+	} else {
+		setOptLevel(opt_level);
+	}
+
+	// streaming lowers statements from the yacc actions and keeps no tree
+	if (stream && (use_rd || hash_cons || dump_ast)) {
+		fprintf(stderr, "--stream works with the yacc parser only, without --hash-cons and --dump-ast\n");
+		return 1;
+	}
+
+	if (inputfile != NULL) {
+		if (lexer_open(inputfile) != 0) {
 			fprintf(stderr, "file open error\n");
 			return 1;
 		}
 	}
+
+	// every node, name and statement list of this compilation lives in the arena
+	astArena arena;
+	arenaInit(&arena);
+	setAstArena(&arena);
+	// equal expressions share one node, built once per basic block
+	if (hash_cons) setHashCons(true);
+
+	if (stream) {
+		puts("Single Pass IR Builder");
+		stream_mode = true;
+		stream_begin();
+	}
 	
-	yyparse(&root);
+	// yyparse can build the program before it finds trailing garbage, so
+	// trust the return value rather than root alone
+	int parse_failed = use_rd ? rdparse(&root) : yyparse(&root);
+	lexer_close();
 
-	if (root == NULL) {
+	if (parse_failed || (root == NULL && !stream)) {
 		printf("Error: root is NULL\n");
 		return -1;
 	}
 
-	//printNode(root);  
+	// --dump-ast stops after parsing, the parsers are compared on this output
+	if (dump_ast) {
+		printNode(root);
+		return 0;
+	}
 
 
 
-	// semantic analysis
-    puts("Semantic Analysis");
-	semantic_analysis(root);
-    puts("Done");
-	// IR builder
+	// the module stays in memory from the IR builder to codegen
+	LLVMModuleRef m = NULL;
+	if (stream) {
+		m = build_module_end();
+		puts("Done");
+	} else {
+		// semantic analysis
+		puts("Semantic Analysis");
+		semantic_analysis(root);
+		puts("Done");
+		// fold constants and drop dead code before any IR is built for it
+		if (optimize) {
+			simplify(root);
+			if (stats) {
+				simplifyStats c = simplifyCounts();
+				printf("simplify: %zu nodes folded, %zu statements pruned\n", c.folded, c.pruned);
+			}
+		}
+		// IR builder
+		puts("IR Builder");
+		m = rename_ast(root);
+		puts("Done");
+	}
 
-    const char * outputfile = "out.ll";
-    puts("IR Builder");
-	rename_ast(root, outputfile);	
-    puts("Done");
+    // the AST is not needed past this point, drop it in one go
+    if (stats) {
+        irStats ir = builderCounts();
+        printf("IR builder: %zu instructions in %zu blocks\n", ir.instructions, ir.blocks);
+        // the frontend's peak: the AST and the module it was lowered into
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printArenaStats(&arena, stdout);
+        printf("frontend peak RSS: %ld KB\n", usage.ru_maxrss);
+    }
+    if (stats && hash_cons) printf("hash-cons: %zu nodes reused\n", hashConsHits());
+    setHashCons(false);
+    setAstArena(NULL);
+    arenaRelease(&arena);
+    root = NULL;
 
-    char *fname = strdup(outputfile);
-    LLVMModuleRef m = createLLVMModel(fname);
-    puts("Optimizations");
-    beginOpt(&m, outputfile);
-    puts("Done");
+    // reading out.ll back used to reject a malformed module, check it here
+    char *err = NULL;
+    if (LLVMVerifyModule(m, LLVMReturnStatusAction, &err)) {
+        fprintf(stderr, "Error: invalid IR\n%s\n", err);
+        LLVMDisposeMessage(err);
+        return -1;
+    }
+    LLVMDisposeMessage(err);
+
+    // textual IR only on request, printing a big module takes longer than optimizing it
+    if (print_ir) {
+        char *ir = LLVMPrintModuleToString(m);
+        printf("%s\n", ir);
+        LLVMDisposeMessage(ir);
+    }
+    if (optimize || passes != NULL) {
+        puts("Optimizations");
+        // timing and diffing every pass costs, only when asked for
+        recordPasses(stats || time_report);
+        beginOpt(&m);
+        puts("Done");
+        if (stats || time_report) printPassReport(stdout);
+        if (time_report && !writePassReport("time-report.json"))
+            fprintf(stderr, "could not write time-report.json\n");
+        if (stats) {
+            printf("inliner: %zu calls inlined\n", inlinedCalls());
+            dataflowStats df = dataflowCounts();
+            printf("liveness: %zu block visits in %zu solves\n", df.liveVisits, df.liveSolves);
+            analysisStats an = analysisCounts();
+            printf("analyses: %zu computed, %zu reused\n", an.computed, an.cached);
+        }
+    }
+    if (emit_llvm) LLVMPrintModuleToFile(m, "out.ll", NULL);
     puts("Asm Gen");
     codegen(&m, NULL);
     puts("Done");
 
-    free(fname);
-
 }
@@ -0,0 +1,20 @@
+extern void print(int);
+extern int read();
+
+int next(int i){
+	return i + 1;
+}
+
+int func(int n){
+	int prod;
+	int i;
+	i = 1;
+	prod = 1;
+	
+	while (i < n){ 
+		i = next(i);
+		prod = prod * i;
+	}
+	
+	return prod;
+}
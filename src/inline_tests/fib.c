@@ -0,0 +1,31 @@
+extern void print(int);
+extern int read();
+
+int show(int a){
+	print(a);
+	return a;
+}
+
+int next(int c){
+	return c + 1;
+}
+
+int func(int n){
+	int a1;
+	int a2;
+	int c;
+	int t;
+
+	a1 = 1;
+	a2 = 1;
+	c = 0;
+
+	while (c < n){
+		t = show(a1);
+		c = next(c);
+		a1 = a2;
+		a2 = t + a2;
+	}
+
+	return 1;
+}
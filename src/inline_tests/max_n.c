@@ -0,0 +1,33 @@
+extern void print(int);
+extern int read();
+
+int positive(int a){
+	if (a > 0)
+		return a;
+	return 0;
+}
+
+int input(){
+	return positive(read());
+}
+
+int next(int i){
+	return i + 1;
+}
+
+int func(int n){
+	int max;
+	int i;
+	int a;
+	max = 0;
+	i = 0;
+	
+	while (i < n){ 
+		a = input();
+		if (a > max)
+			max = a;
+		i = next(i);
+	}
+	
+	return max;
+}
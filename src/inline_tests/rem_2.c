@@ -0,0 +1,15 @@
+extern void print(int);
+extern int read();
+
+int odd(int x){
+	while (x > 1){
+		x = x - 2;
+	}
+	return x;
+}
+
+int func(int n){
+	int res;
+	res = odd(n);
+	return res;
+}
@@ -0,0 +1,12 @@
+extern void print(int);
+extern int read();
+
+int square(int x){
+	return x * x;
+}
+
+int func(int n){
+	int sq;
+	sq = square(n);
+	return sq;
+}
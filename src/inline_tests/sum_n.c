@@ -0,0 +1,28 @@
+extern void print(int);
+extern int read();
+
+int input(){
+	return read();
+}
+
+int add(int a){
+	return a;
+}
+
+int next(int i){
+	return i + 1;
+}
+
+int func(int n){
+	int sum;
+	int i;
+	i = 0;
+	sum = 0;
+	
+	while (i < n){ 
+		sum = sum + add(input());
+		i = next(i);
+	}
+	
+	return sum;
+}
@@ -0,0 +1,26 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	a = 2 * 3 + -(4 - 10) * 2;
+	print(a);
+	if (1 < 2) {
+		int b;
+		b = a + 1;
+		print(b);
+	} else {
+		print(999);
+	}
+	if (2 == 3) print(998);
+	while (4 < 3) {
+		print(997);
+	}
+	while (p < 8) {
+		p = p + 1 * 2;
+		if (5 - 5 != 0) print(996);
+		else print(p);
+	}
+	return a + p;
+	print(995);
+}
@@ -0,0 +1,21 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int i;
+	int x;
+	int y;
+	i = 0;
+	x = 1;
+	y = read();
+	while (i < p) {
+		if (x == 1) {
+			y = y + x;
+		} else {
+			x = 2;
+		}
+		i = i + 1;
+	}
+	print(x);
+	return x + y;
+}
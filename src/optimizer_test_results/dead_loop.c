@@ -0,0 +1,25 @@
+extern void print(int);
+extern int read();
+
+int func(int n){
+	int i;
+	int sum;
+	int prod;
+	int last;
+	i = 0;
+	sum = 0;
+	prod = 1;
+	while (i < n) {
+		sum = sum + i * i;
+		if (sum > 100) {
+			prod = prod * 2;
+		}
+		i = i + 1;
+	}
+	i = 0;
+	while (i < n) {
+		last = read();
+		i = i + 1;
+	}
+	return last;
+}
@@ -0,0 +1,20 @@
+extern void print(int);
+extern int read();
+
+int func(int n){
+	int a;
+	a = read();
+	while (a < n) {
+		if (a > 8) {
+			return a;
+		} else {
+			a = a + read();
+		}
+		print(a);
+	}
+	if (a == n) {
+		return 0;
+		print(a);
+	}
+	return a - n;
+}
@@ -0,0 +1,20 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int a;
+	int b;
+	int c;
+	a = read();
+	b = a * 8 + 0;
+	c = (0 - a) * (0 - b);
+	b = b - (0 - c) + a * 1 - a * 0;
+	c = c * (0 - 1);
+	if (a == a) {
+		print(b - b);
+	} else {
+		print(c);
+	}
+	print(c * 4);
+	return b + (0 - c);
+}
@@ -0,0 +1,25 @@
+extern void print(int);
+extern int read();
+
+int func(int p){
+	int i;
+	int sum;
+	int last;
+	i = 0;
+	sum = 0;
+	last = read();
+	while (i < p) {
+		int x;
+		x = read();
+		if (x > last) {
+			sum = sum + x;
+		} else {
+			sum = sum - 1;
+		}
+		if (i == 2) print(sum);
+		last = x;
+		i = i + 1;
+	}
+	print(last);
+	return sum;
+}
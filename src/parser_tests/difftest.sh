@@ -0,0 +1,44 @@
+#!/bin/sh
+# Differential test of the two parsers: every sample program, and random
+# programs from stress_tests/gen_stress with and without a line cut out,
+# must give the same printNode dump and diagnostics with --parser=rd as
+# with --parser=yacc. Run from src/ after make:
+#	sh parser_tests/difftest.sh [number of random programs]
+COMPILER=${COMPILER:-./compiler}
+COUNT=${1:-200}
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+failed=0
+
+check() {
+	(cd $TMP && $COMPILER --dump-ast --parser=yacc "$1" > yacc.txt 2>&1)
+	(cd $TMP && $COMPILER --dump-ast --parser=rd "$1" > rd.txt 2>&1)
+	if ! cmp -s $TMP/yacc.txt $TMP/rd.txt; then
+		echo "parsers differ on $2"
+		diff $TMP/yacc.txt $TMP/rd.txt | head -10
+		failed=1
+	fi
+}
+
+case $COMPILER in
+	/*) ;;
+	*) COMPILER=$(pwd)/$COMPILER ;;
+esac
+
+for f in parser_tests/*.c assembly_gen_tests/*.c optimizer_test_results/*.c; do
+	check $(pwd)/$f $f
+done
+
+cc -O2 stress_tests/gen_stress.c -o $TMP/gen_stress || exit 1
+i=1
+while [ $i -le $COUNT ]; do
+	$TMP/gen_stress random $i > $TMP/random.c
+	check $TMP/random.c "gen_stress random $i"
+	lines=$(wc -l < $TMP/random.c)
+	sed "$((i % lines + 1))d" $TMP/random.c > $TMP/cut.c
+	check $TMP/cut.c "gen_stress random $i without line $((i % lines + 1))"
+	i=$((i + 1))
+done
+
+[ $failed -eq 0 ] && echo "parsers agree"
+exit $failed
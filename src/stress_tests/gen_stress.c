@@ -0,0 +1,137 @@
+/*
+Writes miniC programs that stress how deep the compiler can nest. Usage:
+	./gen_stress expr N   one assignment whose right hand side is a chain
+	                      of N terms (a left-deep tree N levels deep)
+	./gen_stress nest N   N if/while statements nested in each other
+	./gen_stress flat N   N statements one after the other, a long
+	                      function that is never nested deeply
+	./gen_stress random S a random program from seed S, for comparing
+	                      the two parsers (see parser_tests/difftest.sh)
+The program goes to stdout.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void genExpr(long terms){
+	printf("\ta = p;\n\ta = a");
+	for (long i = 1; i < terms; i++){
+		// mix the operators the backend supports
+		switch (i % 3){
+			case 0: printf(" + a"); break;
+			case 1: printf(" - %ld", i % 100); break;
+			default: printf(" + p"); break;
+		}
+		if (i % 16 == 0)
+			printf("\n");
+	}
+	printf(";\n");
+}
+
+static void genNest(long depth){
+	printf("\ta = p;\n");
+	for (long i = 0; i < depth; i++){
+		if (i % 2 == 0)
+			printf("if (a < %ld) {\n", i);
+		else
+			printf("while (a > %ld) {\n", i);
+	}
+	printf("a = a - 1;\n");
+	for (long i = 0; i < depth; i++)
+		printf("}\n");
+}
+
+static void genFlat(long stmts){
+	printf("\ta = p;\n");
+	for (long i = 0; i < stmts; i++){
+		switch (i % 4){
+			case 0: printf("\ta = a + p * %ld - 1;\n", i % 100); break;
+			case 1: printf("\tif (a < p) { a = a + 1; } else { print(a); }\n"); break;
+			case 2: printf("\twhile (a > %ld) { int t; t = a; a = t - 1; }\n", i % 50); break;
+			default: printf("\tprint(a + p);\n"); break;
+		}
+	}
+}
+
+static unsigned long rnd_state;
+
+static unsigned rnd(unsigned n){
+	rnd_state = rnd_state * 6364136223846793005ul + 1442695040888963407ul;
+	return (unsigned) (rnd_state >> 33) % n;
+}
+
+static void genRandomExpr(int depth){
+	static const char *ops[] = {"+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!="};
+	switch (depth <= 0 ? rnd(3) : rnd(7)){
+		case 0: printf("%u", rnd(1000)); break;
+		case 1: printf("v%u", rnd(4)); break;
+		case 2: printf("read()"); break;
+		case 3: printf("("); genRandomExpr(depth - 1); printf(")"); break;
+		case 4: printf("-"); genRandomExpr(depth - 1); break;
+		default:
+			genRandomExpr(depth - 1);
+			printf(" %s ", ops[rnd(10)]);
+			genRandomExpr(depth - 1);
+			break;
+	}
+}
+
+static void genRandomBlock(int depth);
+
+static void genRandomStmt(int depth){
+	switch (depth <= 0 ? rnd(4) : rnd(9)){
+		case 0:
+		case 1: printf("v%u = ", rnd(4)); genRandomExpr(3); printf(";\n"); break;
+		case 2: printf("print("); genRandomExpr(2); printf(");\n"); break;
+		case 3: genRandomExpr(2); printf(";\n"); break;
+		case 4: printf("return "); genRandomExpr(2); printf(";\n"); break;
+		case 5: printf("while ("); genRandomExpr(2); printf(") "); genRandomBlock(depth - 1); break;
+		case 6: genRandomBlock(depth - 1); break;
+		default:
+			// bodies without braces exercise the dangling else
+			printf("if ("); genRandomExpr(2); printf(")\n");
+			genRandomStmt(depth - 1);
+			if (rnd(2)){
+				printf("else\n");
+				genRandomStmt(depth - 1);
+			}
+			break;
+	}
+}
+
+static void genRandomBlock(int depth){
+	printf("{\n");
+	for (unsigned i = rnd(3); i > 0; i--)
+		printf("int v%u;\n", rnd(4));
+	for (unsigned i = rnd(5); i > 0; i--)
+		genRandomStmt(depth);
+	printf("}\n");
+}
+
+int main(int argc, char **argv){
+	if (argc == 3 && strcmp(argv[1], "random") == 0){
+		rnd_state = strtoul(argv[2], NULL, 10);
+		printf("extern void print(int);\nextern int read();\n\n");
+		printf("int func(int v0)");
+		genRandomBlock(4);
+		return 0;
+	}
+	if (argc != 3 || (strcmp(argv[1], "expr") != 0 && strcmp(argv[1], "nest") != 0 && strcmp(argv[1], "flat") != 0)){
+		fprintf(stderr, "usage: %s expr|nest|flat N, or %s random SEED\n", argv[0], argv[0]);
+		return 1;
+	}
+	long n = atol(argv[2]);
+	if (n < 1)
+		n = 1;
+
+	printf("extern void print(int);\nextern int read();\n\n");
+	printf("int func(int p){\n\tint a;\n");
+	if (strcmp(argv[1], "expr") == 0)
+		genExpr(n);
+	else if (strcmp(argv[1], "flat") == 0)
+		genFlat(n);
+	else
+		genNest(n);
+	printf("\treturn a;\n}\n");
+	return 0;
+}